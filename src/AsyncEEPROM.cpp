@@ -0,0 +1,211 @@
+  /*
+   * Copyright (C) 2020  Patrick Pedersen, The TU-DO Makespace
+
+   * This program is free software: you can redistribute it and/or modify
+   * it under the terms of the GNU General Public License as published by
+   * the Free Software Foundation, either version 3 of the License, or
+   * (at your option) any later version.
+
+   * This program is distributed in the hope that it will be useful,
+   * but WITHOUT ANY WARRANTY; without even the implied warranty of
+   * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   * GNU General Public License for more details.
+
+   * You should have received a copy of the GNU General Public License
+   * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+   *
+   * Author: Patrick Pedersen <ctx.xda@gmail.com>
+   * Description: Method/Function definitions for the AsyncEEPROM class
+   *
+   */
+
+#include <Arduino.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+#include "AsyncEEPROM.h"
+
+#define QUEUE_NEXT(i) (((i) + 1) & (EEPROM_QUEUE_SIZE - 1))
+
+static_assert((EEPROM_QUEUE_SIZE & (EEPROM_QUEUE_SIZE - 1)) == 0, "EEPROM_QUEUE_SIZE must be a power of two");
+
+AsyncEEPROM async_eeprom;
+
+ISR(EE_READY_vect)
+{
+        async_eeprom.isr();
+}
+
+/* AsyncEEPROM
+ * -----------
+ * Description:
+ *      Initializes an empty write queue
+ */
+
+AsyncEEPROM::AsyncEEPROM() : _head(0), _tail(0)
+{
+
+}
+
+/* AsyncEEPROM::pause
+ * ------------------
+ * Description:
+ *      Stops the ISR from starting further writes and waits for the byte
+ *      in flight, after which the EEPROM and the queue may be accessed.
+ */
+
+void AsyncEEPROM::pause()
+{
+        EECR &= ~_BV(EERIE);
+
+        while (EECR & _BV(EEPE));
+}
+
+/* AsyncEEPROM::resume
+ * -------------------
+ * Description:
+ *      Lets the ISR continue draining the queue
+ */
+
+void AsyncEEPROM::resume()
+{
+        if (_head != _tail)
+                EECR |= _BV(EERIE);
+}
+
+/* AsyncEEPROM::read_block
+ * -----------------------
+ * Parameters:
+ *      addr - EEPROM address
+ *      data - Return buffer
+ *      len - Number of bytes to be read
+ * Description:
+ *      Reads a block of bytes, with pending writes taking precedence
+ *      over the EEPROM content.
+ */
+
+void AsyncEEPROM::read_block(uint16_t addr, void *data, uint16_t len)
+{
+        uint8_t *bytes = (uint8_t *) data;
+
+        pause();
+
+        for (uint16_t i = 0; i < len; i++, addr++) {
+                bool pending = false;
+
+                // The newest pending write of a byte is its effective value
+                for (uint8_t j = _head; j != _tail; j = QUEUE_NEXT(j)) {
+                        if (_queue[j].addr == addr) {
+                                bytes[i] = _queue[j].val;
+                                pending = true;
+                        }
+                }
+
+                if (!pending) {
+                        EEAR = addr;
+                        EECR |= _BV(EERE);
+                        bytes[i] = EEDR;
+                }
+        }
+
+        resume();
+}
+
+uint8_t AsyncEEPROM::read(uint16_t addr)
+{
+        uint8_t val;
+        read_block(addr, &val, 1);
+        return val;
+}
+
+/* AsyncEEPROM::write
+ * ------------------
+ * Parameters:
+ *      addr - EEPROM address
+ *      val - Value to be written
+ * Description:
+ *      Queues a byte write. Blocks only if the queue is full.
+ *      Writes are performed strictly in the order they were queued, which
+ *      callers may rely on for crash consistency (ex. the journal header
+ *      being written after the records).
+ */
+
+void AsyncEEPROM::write(uint16_t addr, uint8_t val)
+{
+        for (;;) {
+                ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+                        if (QUEUE_NEXT(_tail) != _head) {
+                                _queue[_tail].addr = addr;
+                                _queue[_tail].val = val;
+                                _tail = QUEUE_NEXT(_tail);
+                                EECR |= _BV(EERIE);
+                                return;
+                        }
+                }
+        }
+}
+
+void AsyncEEPROM::write_block(uint16_t addr, const void *data, uint16_t len)
+{
+        const uint8_t *bytes = (const uint8_t *) data;
+
+        for (uint16_t i = 0; i < len; i++)
+                write(addr + i, bytes[i]);
+}
+
+/* AsyncEEPROM::pending
+ * --------------------
+ * Returns:
+ *      The number of queued byte writes
+ */
+
+uint8_t AsyncEEPROM::pending()
+{
+        uint8_t pending;
+
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+                pending = (_tail - _head) & (EEPROM_QUEUE_SIZE - 1);
+        }
+
+        return pending;
+}
+
+/* AsyncEEPROM::flush
+ * ------------------
+ * Description:
+ *      Write barrier, waits until all pending writes have completed
+ */
+
+void AsyncEEPROM::flush()
+{
+        while (_head != _tail || (EECR & _BV(EEPE)));
+}
+
+/* AsyncEEPROM::isr
+ * ----------------
+ * Description:
+ *      Called by the EEPROM ready ISR. Starts the next queued write whose
+ *      value differs from the EEPROM content. Once the queue is drained,
+ *      the interrupt is disabled.
+ */
+
+void AsyncEEPROM::isr()
+{
+        while (_head != _tail) {
+                eeprom_write w = _queue[_head];
+                _head = QUEUE_NEXT(_head);
+
+                EEAR = w.addr;
+                EECR |= _BV(EERE);
+
+                if (EEDR == w.val)
+                        continue;
+
+                EEDR = w.val;
+                EECR |= _BV(EEMPE);
+                EECR |= _BV(EEPE);
+                return;
+        }
+
+        EECR &= ~_BV(EERIE);
+}
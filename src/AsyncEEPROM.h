@@ -0,0 +1,95 @@
+  /*
+   * Copyright (C) 2020  Patrick Pedersen, The TU-DO Makespace
+
+   * This program is free software: you can redistribute it and/or modify
+   * it under the terms of the GNU General Public License as published by
+   * the Free Software Foundation, either version 3 of the License, or
+   * (at your option) any later version.
+
+   * This program is distributed in the hope that it will be useful,
+   * but WITHOUT ANY WARRANTY; without even the implied warranty of
+   * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   * GNU General Public License for more details.
+
+   * You should have received a copy of the GNU General Public License
+   * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+   *
+   * Author: Patrick Pedersen <ctx.xda@gmail.com>
+   * Description: Interrupt driven, non-blocking EEPROM access
+   *
+   */
+
+#pragma once
+
+#include <stdint.h>
+
+#define EEPROM_QUEUE_SIZE 32 // Number of pending byte writes, must be a power of two
+
+/*
+ * eeprom_write
+ * ------------
+ * Description:
+ *      A pending byte write
+ */
+
+struct eeprom_write {
+        uint16_t addr;
+        uint8_t val;
+};
+
+/*
+ * AsyncEEPROM
+ * -----------
+ * Description:
+ *      A drop-in replacement for the Arduino EEPROM library whose writes don't
+ *      block. Instead of busy-waiting ~3.4 ms per byte, writes are queued and
+ *      drained in the background by the EEPROM ready interrupt. Bytes which
+ *      already hold the written value are skipped, so writes behave like
+ *      EEPROM.update().
+ *
+ *      Reads are coherent with pending writes: the newest pending value of a
+ *      byte is returned in place of the EEPROM content. As the EEPROM can't
+ *      be read while a byte is being written, a read may wait for the byte
+ *      currently in flight, but never for the rest of the queue.
+ *
+ *      Writes only block if the queue is full. flush() waits until all
+ *      pending writes have completed (ex. before relying on the data surviving
+ *      a reset).
+ */
+
+class AsyncEEPROM
+{
+        eeprom_write _queue[EEPROM_QUEUE_SIZE];
+        volatile uint8_t _head;         // Next write to be performed by the ISR
+        volatile uint8_t _tail;         // Next free queue entry
+
+        void pause();
+        void resume();
+
+public:
+        AsyncEEPROM();
+
+        uint8_t read(uint16_t addr);
+        void read_block(uint16_t addr, void *data, uint16_t len);
+        void write(uint16_t addr, uint8_t val);
+        void write_block(uint16_t addr, const void *data, uint16_t len);
+        uint8_t pending();
+        void flush();
+        void isr();
+
+        // Counterparts of EEPROM.get() and EEPROM.put()
+
+        template <typename T> T &get(uint16_t addr, T &t)
+        {
+                read_block(addr, &t, sizeof(T));
+                return t;
+        }
+
+        template <typename T> const T &put(uint16_t addr, const T &t)
+        {
+                write_block(addr, &t, sizeof(T));
+                return t;
+        }
+};
+
+extern AsyncEEPROM async_eeprom;
@@ -0,0 +1,273 @@
+  /*
+   * Copyright (C) 2020  Patrick Pedersen, The TU-DO Makespace
+
+   * This program is free software: you can redistribute it and/or modify
+   * it under the terms of the GNU General Public License as published by
+   * the Free Software Foundation, either version 3 of the License, or
+   * (at your option) any later version.
+
+   * This program is distributed in the hope that it will be useful,
+   * but WITHOUT ANY WARRANTY; without even the implied warranty of
+   * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   * GNU General Public License for more details.
+
+   * You should have received a copy of the GNU General Public License
+   * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+   *
+   * Author: Patrick Pedersen <ctx.xda@gmail.com>
+   * Description: Method/Function definitions for the BAMDimmer class
+   *
+   */
+
+#include <Arduino.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+#include "BAMDimmer.h"
+
+static BAMDimmer *bam_instance = NULL; // Instance served by the Timer1 ISR
+
+/* bam_isr
+ * -------
+ * Description:
+ *      Forwards the Timer1 compare interrupt to the active BAMDimmer instance
+ */
+
+void bam_isr()
+{
+        bam_instance->isr();
+}
+
+ISR(TIMER1_COMPA_vect)
+{
+        bam_isr();
+}
+
+/* BAMDimmer
+ * ---------
+ * Description:
+ *      Empty constructor for a BAMDimmer object (useful for arrays and pointers)
+ */
+
+BAMDimmer::BAMDimmer()
+{
+
+}
+
+/* BAMDimmer
+ * ---------
+ * Parameters:
+ *      pins - Array of output pins, one per channel
+ *      channels - Number of channels/pins
+ * Description:
+ *      Initializes a BAM driver for the provided pins.
+ *      The driver remains idle until begin() is called.
+ */
+
+BAMDimmer::BAMDimmer(const uint8_t *pins, uint8_t channels) : _channels(channels), _pins(pins)
+{
+        _levels = new uint8_t[_channels];
+        memset(_levels, 0, _channels);
+        memset(_planes, 0, sizeof(_planes));
+
+        _dirty = false;
+        _nports = 0;
+        _front = 0;
+        _swap = false;
+        _plane = 0;
+        _busy_ticks = 0;
+        _load_ticks = 0;
+}
+
+BAMDimmer::~BAMDimmer()
+{
+        delete[] _levels;
+        _levels = NULL;
+}
+
+/* BAMDimmer::begin
+ * ----------------
+ * Description:
+ *      Sets all channel pins to outputs, precomputes the port masks
+ *      and starts Timer1 in CTC mode with a prescaler of 8.
+ *      Must be called from setup(), as the Arduino core claims
+ *      Timer1 for analogWrite() during initialization.
+ */
+
+void BAMDimmer::begin()
+{
+        for (uint8_t i = 0; i < _channels; i++) {
+                volatile uint8_t *port = portOutputRegister(digitalPinToPort(_pins[i]));
+                uint8_t p = 0;
+
+                pinMode(_pins[i], OUTPUT);
+                digitalWrite(_pins[i], LOW);
+
+                while (p < _nports && _ports[p] != port)
+                        p++;
+
+                if (p == _nports) {
+                        _ports[p] = port;
+                        _port_masks[p] = 0;
+                        _nports++;
+                }
+
+                _port_masks[p] |= digitalPinToBitMask(_pins[i]);
+        }
+
+        bam_instance = this;
+        _dirty = true;
+        commit();
+
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+                TCCR1A = 0;
+                TCCR1B = _BV(WGM12) | _BV(CS11);
+                TCNT1 = 0;
+                OCR1A = BAM_BASE_TICKS - 1;
+                TIMSK1 |= _BV(OCIE1A);
+        }
+}
+
+/* BAMDimmer::set
+ * --------------
+ * Parameters:
+ *      channel - Channel to be dimmed
+ *      brightness - Brightness of the channel
+ * Description:
+ *      Sets the brightness of a channel.
+ *      The change is applied on the next commit() call.
+ */
+
+void BAMDimmer::set(uint8_t channel, uint8_t brightness)
+{
+        if (channel >= _channels || _levels[channel] == brightness)
+                return;
+
+        _levels[channel] = brightness;
+        _dirty = true;
+}
+
+/* BAMDimmer::get
+ * --------------
+ * Parameters:
+ *      channel - Channel to be read
+ * Returns:
+ *      The brightness of the channel
+ */
+
+uint8_t BAMDimmer::get(uint8_t channel)
+{
+        return (channel < _channels) ? _levels[channel] : 0;
+}
+
+/* BAMDimmer::channels
+ * -------------------
+ * Returns:
+ *      The number of channels driven by the BAM driver
+ */
+
+uint8_t BAMDimmer::channels()
+{
+        return _channels;
+}
+
+/* BAMDimmer::commit
+ * -----------------
+ * Description:
+ *      Precomputes the port states of all bitplanes into the back buffer
+ *      and schedules the buffer to be shown from the start of the next period.
+ *      If the previously committed buffer has not been picked up by the ISR yet,
+ *      the commit is deferred to the next call.
+ */
+
+void BAMDimmer::commit()
+{
+        if (!_dirty || _swap)
+                return;
+
+        uint8_t back = _front ^ 1;
+
+        memset(_planes[back], 0, sizeof(_planes[back]));
+
+        for (uint8_t i = 0; i < _channels; i++) {
+                volatile uint8_t *port = portOutputRegister(digitalPinToPort(_pins[i]));
+                uint8_t mask = digitalPinToBitMask(_pins[i]);
+                uint8_t p = 0;
+
+                while (p < _nports && _ports[p] != port)
+                        p++;
+
+                for (uint8_t plane = 0; plane < BAM_BITS; plane++) {
+                        if (_levels[i] & (1 << plane))
+                                _planes[back][plane][p] |= mask;
+                }
+        }
+
+        _dirty = false;
+        _swap = true;
+}
+
+/* BAMDimmer::load
+ * ---------------
+ * Returns:
+ *      The CPU load caused by the BAM ISR during the last period in permille
+ * Description:
+ *      The load is measured by sampling Timer1 at the end of every ISR,
+ *      which yields the time passed since the compare match, including
+ *      interrupt latency.
+ */
+
+uint16_t BAMDimmer::load()
+{
+        uint16_t ticks;
+
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+                ticks = _load_ticks;
+        }
+
+        return ((uint32_t) ticks * 1000) / BAM_PERIOD_TICKS;
+}
+
+/* BAMDimmer::isr
+ * --------------
+ * Description:
+ *      Outputs the next bitplane and sets its duration.
+ *      Called by the Timer1 compare ISR at the end of every bitplane.
+ *      Catches up with the schedule if the ISR has been delayed past the
+ *      end of the new plane.
+ */
+
+void BAMDimmer::isr()
+{
+        uint8_t plane = _plane;
+
+        OCR1A = (BAM_BASE_TICKS << plane) - 1;
+
+        if (plane == 0) {
+                if (_swap) {
+                        _front ^= 1;
+                        _swap = false;
+                }
+
+                _load_ticks = _busy_ticks;
+                _busy_ticks = 0;
+        }
+
+        const uint8_t *state = _planes[_front][plane];
+
+        for (uint8_t p = 0; p < _nports; p++)
+                *_ports[p] = (*_ports[p] & ~_port_masks[p]) | state[p];
+
+        _plane = (plane + 1) % BAM_BITS;
+
+        uint16_t ticks = TCNT1;
+
+        // If the ISR was held off for longer than the new plane lasts, the counter has
+        // already passed the compare value and would run through all 16 bits (~32 ms).
+        // Instead, the plane is cut short and the next one follows right away. Writing
+        // TCNT1 blocks a compare match on the next timer tick, hence two ticks ahead.
+        if (ticks > OCR1A)
+                TCNT1 = OCR1A - 2;
+
+        _busy_ticks += ticks;
+}
@@ -0,0 +1,85 @@
+  /*
+   * Copyright (C) 2020  Patrick Pedersen, The TU-DO Makespace
+
+   * This program is free software: you can redistribute it and/or modify
+   * it under the terms of the GNU General Public License as published by
+   * the Free Software Foundation, either version 3 of the License, or
+   * (at your option) any later version.
+
+   * This program is distributed in the hope that it will be useful,
+   * but WITHOUT ANY WARRANTY; without even the implied warranty of
+   * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   * GNU General Public License for more details.
+
+   * You should have received a copy of the GNU General Public License
+   * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+   *
+   * Author: Patrick Pedersen <ctx.xda@gmail.com>
+   * Description: A Bit Angle Modulation driver for mono LED strips on non-PWM pins
+   *
+   */
+
+#pragma once
+
+#include <stdint.h>
+
+#define BAM_BITS      8 // Resolution of each channel (one bitplane per bit)
+#define BAM_MAX_PORTS 3 // PORTB, PORTC and PORTD on the ATmega328
+
+#ifndef BAM_BASE_TICKS
+#define BAM_BASE_TICKS 32 // Timer1 ticks (0.5us) of the least significant bitplane
+#endif
+
+#define BAM_PERIOD_TICKS (((1 << BAM_BITS) - 1) * (uint32_t) BAM_BASE_TICKS)
+
+/*
+ * BAMDimmer
+ * ---------
+ * Description:
+ *      Dims any number of mono LED strips on arbitrary GPIOs using Bit Angle Modulation.
+ *      Each period is split into BAM_BITS bitplanes, where the nth plane lasts
+ *      BAM_BASE_TICKS * 2^n timer ticks and outputs the nth bit of every channel.
+ *      The output state of every plane is precomputed as one mask per port, so the
+ *      Timer1 compare ISR only performs a single masked write per port.
+ *
+ *      Only one instance may exist, as the driver occupies Timer1.
+ *      Note that interrupt-free sections (ex. NeoPixelBus::Show(), ~0.9 ms for 30 LEDs)
+ *      delay bitplane switching. The delayed plane is then shown for too long and,
+ *      should the delay exceed the duration of the following plane, that plane is
+ *      skipped, which distorts the brightness of a single period.
+ */
+
+class BAMDimmer
+{
+        uint8_t _channels;                                      // Number of channels
+        const uint8_t *_pins;                                   // Pins of all channels
+        uint8_t *_levels;                                       // Brightness of all channels
+        bool _dirty;                                            // True if levels have changed since the last commit
+
+        uint8_t _nports;                                        // Number of ports used by the channels
+        volatile uint8_t *_ports[BAM_MAX_PORTS];                // Output registers of used ports
+        uint8_t _port_masks[BAM_MAX_PORTS];                     // Pins owned by the driver on each port
+        uint8_t _planes[2][BAM_BITS][BAM_MAX_PORTS];            // Double buffered port states of each bitplane
+
+        volatile uint8_t _front;                                // Bitplane buffer currently output by the ISR
+        volatile bool _swap;                                    // True if the back buffer is to be shown next period
+        volatile uint8_t _plane;                                // Bitplane currently output by the ISR
+
+        volatile uint16_t _busy_ticks;                          // Timer ticks spent in the ISR during the current period
+        volatile uint16_t _load_ticks;                          // Timer ticks spent in the ISR during the last period
+
+        void isr();
+        friend void bam_isr();                                  // Timer1 compare ISR trampoline
+
+public:
+        BAMDimmer();
+        BAMDimmer(const uint8_t *pins, uint8_t channels);
+        ~BAMDimmer();
+
+        void begin();
+        void set(uint8_t channel, uint8_t brightness);
+        uint8_t get(uint8_t channel);
+        uint8_t channels();
+        void commit();
+        uint16_t load();
+};
@@ -0,0 +1,112 @@
+  /*
+   * Copyright (C) 2020  Patrick Pedersen, The TU-DO Makespace
+
+   * This program is free software: you can redistribute it and/or modify
+   * it under the terms of the GNU General Public License as published by
+   * the Free Software Foundation, either version 3 of the License, or
+   * (at your option) any later version.
+
+   * This program is distributed in the hope that it will be useful,
+   * but WITHOUT ANY WARRANTY; without even the implied warranty of
+   * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   * GNU General Public License for more details.
+
+   * You should have received a copy of the GNU General Public License
+   * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+   *
+   * Author: Patrick Pedersen <ctx.xda@gmail.com>
+   * Description: Method/Function definitions for the Crossfade class
+   *
+   */
+
+#include <Arduino.h>
+#include "Crossfade.h"
+
+/* Crossfade
+ * ---------
+ * Description:
+ *      Initializes an inactive crossfade
+ */
+
+Crossfade::Crossfade() : _active(false)
+{
+
+}
+
+/* Crossfade::start
+ * ----------------
+ * Parameters:
+ *      from - Levels to fade from (usually the currently output levels)
+ *      to - Levels to fade to
+ *      duration - Duration of the fade in ms
+ * Description:
+ *      Starts a new fade, replacing any fade in progress.
+ */
+
+void Crossfade::start(const uint16_t *from, const uint16_t *to, unsigned long duration)
+{
+        for (uint8_t i = 0; i < CROSSFADE_CHANNELS; i++) {
+                _from[i] = from[i];
+                _to[i] = to[i];
+        }
+
+        _duration = duration;
+        _start_tstamp = millis();
+        _active = true;
+}
+
+/* Crossfade::stop
+ * ---------------
+ * Description:
+ *      Aborts the fade in progress (ex. when the user takes over control)
+ */
+
+void Crossfade::stop()
+{
+        _active = false;
+}
+
+/* Crossfade::active
+ * -----------------
+ * Returns:
+ *      True, if a fade is in progress
+ */
+
+bool Crossfade::active()
+{
+        return _active;
+}
+
+/* Crossfade::step
+ * ---------------
+ * Parameters:
+ *      levels - Return array for the current levels
+ * Returns:
+ *      True if the fade is still in progress, false if it has finished.
+ * Description:
+ *      Computes the levels at the current time. The progress of the fade
+ *      is expressed as a 0.15 fixed-point fraction, by which the distance
+ *      between the start and target levels is scaled.
+ */
+
+bool Crossfade::step(uint16_t *levels)
+{
+        unsigned long elapsed = millis() - _start_tstamp;
+
+        if (elapsed >= _duration) {
+                for (uint8_t i = 0; i < CROSSFADE_CHANNELS; i++)
+                        levels[i] = _to[i];
+
+                _active = false;
+                return false;
+        }
+
+        uint16_t pos = ((uint32_t) elapsed << 15) / _duration;
+
+        for (uint8_t i = 0; i < CROSSFADE_CHANNELS; i++) {
+                int32_t delta = (int32_t) _to[i] - _from[i];
+                levels[i] = _from[i] + (int16_t) ((delta * pos) >> 15);
+        }
+
+        return true;
+}
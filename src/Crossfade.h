@@ -0,0 +1,52 @@
+  /*
+   * Copyright (C) 2020  Patrick Pedersen, The TU-DO Makespace
+
+   * This program is free software: you can redistribute it and/or modify
+   * it under the terms of the GNU General Public License as published by
+   * the Free Software Foundation, either version 3 of the License, or
+   * (at your option) any later version.
+
+   * This program is distributed in the hope that it will be useful,
+   * but WITHOUT ANY WARRANTY; without even the implied warranty of
+   * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   * GNU General Public License for more details.
+
+   * You should have received a copy of the GNU General Public License
+   * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+   *
+   * Author: Patrick Pedersen <ctx.xda@gmail.com>
+   * Description: Non-blocking, timed crossfades between light levels
+   *
+   */
+
+#pragma once
+
+#include <stdint.h>
+
+#define CROSSFADE_CHANNELS 4 // R, G, B and main light
+
+/*
+ * Crossfade
+ * ---------
+ * Description:
+ *      Interpolates a set of 8.8 fixed-point levels from a start to a target
+ *      over a given duration. The fade doesn't block; instead step() is
+ *      called once per frame to obtain the current levels.
+ */
+
+class Crossfade
+{
+        uint16_t _from[CROSSFADE_CHANNELS];     // Levels at the start of the fade
+        uint16_t _to[CROSSFADE_CHANNELS];       // Target levels
+        unsigned long _start_tstamp;            // Timestamp of the start of the fade
+        unsigned long _duration;                // Duration of the fade in ms
+        bool _active;                           // True while a fade is in progress
+
+public:
+        Crossfade();
+
+        void start(const uint16_t *from, const uint16_t *to, unsigned long duration);
+        void stop();
+        bool active();
+        bool step(uint16_t *levels);
+};
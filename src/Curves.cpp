@@ -0,0 +1,223 @@
+  /*
+   * Copyright (C) 2020  Patrick Pedersen, The TU-DO Makespace
+
+   * This program is free software: you can redistribute it and/or modify
+   * it under the terms of the GNU General Public License as published by
+   * the Free Software Foundation, either version 3 of the License, or
+   * (at your option) any later version.
+
+   * This program is distributed in the hope that it will be useful,
+   * but WITHOUT ANY WARRANTY; without even the implied warranty of
+   * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   * GNU General Public License for more details.
+
+   * You should have received a copy of the GNU General Public License
+   * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+   *
+   * Author: Patrick Pedersen <ctx.xda@gmail.com>
+   * Description: Compile-time generated lookup tables for the brightness curves
+   *
+   */
+
+#include <avr/pgmspace.h>
+
+#include "config.h"
+#include "Curves.h"
+
+#define CURVE_LUT_SIZE 256
+
+//////////////////////////////
+// Compile-time math
+//////////////////////////////
+
+// avr-libc's math functions are not constexpr, hence the
+// following minimal replacements, which are only ever
+// evaluated by the compiler.
+
+/* cx_ln
+ * -----
+ * Arguments:
+ *      x - A positive value
+ * Returns:
+ *      The natural logarithm of x
+ * Description:
+ *      Scales x into [0.5, 1] and evaluates ln(m) = 2 * atanh((m - 1)/(m + 1))
+ */
+
+constexpr double cx_ln(double x)
+{
+        const double ln2 = 0.69314718055994530942;
+        int exp2 = 0;
+
+        while (x > 1.0) {
+                x /= 2.0;
+                exp2++;
+        }
+
+        while (x < 0.5) {
+                x *= 2.0;
+                exp2--;
+        }
+
+        double y = (x - 1.0) / (x + 1.0);
+        double term = y;
+        double sum = 0.0;
+
+        for (int n = 1; n < 60; n += 2) {
+                sum += term / n;
+                term *= y * y;
+        }
+
+        return 2.0 * sum + exp2 * ln2;
+}
+
+/* cx_exp
+ * ------
+ * Arguments:
+ *      x - A value <= 0
+ * Returns:
+ *      e^x
+ * Description:
+ *      Evaluates the taylor series of e^(x/1024) and squares the result 10 times
+ */
+
+constexpr double cx_exp(double x)
+{
+        double y = x / 1024.0;
+        double term = 1.0;
+        double sum = 1.0;
+
+        for (int n = 1; n < 20; n++) {
+                term *= y / n;
+                sum += term;
+        }
+
+        for (int i = 0; i < 10; i++)
+                sum *= sum;
+
+        return sum;
+}
+
+/* cx_pow
+ * ------
+ * Arguments:
+ *      base - A value in [0, 1]
+ *      exp - A positive exponent
+ * Returns:
+ *      base^exp
+ */
+
+constexpr double cx_pow(double base, double exp)
+{
+        return (base <= 0.0) ? 0.0 : cx_exp(exp * cx_ln(base));
+}
+
+//////////////////////////////
+// Curves
+//////////////////////////////
+
+/* gamma_correct
+ * -------------
+ * Arguments:
+ *      x - Normalized input brightness [0, 1]
+ * Returns:
+ *      x^GAMMA
+ */
+
+constexpr double gamma_correct(double x)
+{
+        return cx_pow(x, GAMMA);
+}
+
+/* cie_lightness
+ * -------------
+ * Arguments:
+ *      x - Normalized lightness (L* divided by 100) [0, 1]
+ * Returns:
+ *      Normalized luminance (Y) according to CIE 1931
+ */
+
+constexpr double cie_lightness(double x)
+{
+        double l = x * 100.0;
+
+        if (l <= 8.0)
+                return l / 903.3;
+
+        double f = (l + 16.0) / 116.0;
+        return f * f * f;
+}
+
+//////////////////////////////
+// Lookup tables
+//////////////////////////////
+
+struct curve_lut {
+        uint16_t val[CURVE_LUT_SIZE];
+};
+
+/* make_lut
+ * --------
+ * Arguments:
+ *      curve - Curve mapping a normalized input to a normalized output
+ * Returns:
+ *      A lookup table mapping all 8-bit inputs to rounded CURVE_OUT_BITS outputs
+ */
+
+constexpr curve_lut make_lut(double (*curve)(double))
+{
+        curve_lut lut {};
+
+        for (int i = 0; i < CURVE_LUT_SIZE; i++)
+                lut.val[i] = (uint16_t) (curve(i / 255.0) * CURVE_OUT_MAX + 0.5);
+
+        return lut;
+}
+
+constexpr curve_lut gamma_lut PROGMEM = make_lut(gamma_correct);
+constexpr curve_lut cie_lut PROGMEM = make_lut(cie_lightness);
+
+/* apply_curve
+ * -----------
+ * Arguments:
+ *      curve - Brightness curve to be applied
+ *      val - Linear 8-bit input value
+ * Returns:
+ *      The CURVE_OUT_BITS output value of the provided curve
+ */
+
+uint16_t apply_curve(curve_type curve, uint8_t val)
+{
+        switch (curve) {
+                case gamma_curve:
+                        return pgm_read_word(&gamma_lut.val[val]);
+                case cie_curve:
+                        return pgm_read_word(&cie_lut.val[val]);
+                default:
+                        return ((uint16_t) val << (CURVE_OUT_BITS - 8)) | (val >> (16 - CURVE_OUT_BITS));
+        }
+}
+
+/* apply_curve_fine
+ * ----------------
+ * Arguments:
+ *      curve - Brightness curve to be applied
+ *      level - Linear 8.8 fixed-point input level
+ * Returns:
+ *      The CURVE_OUT_BITS output value of the provided curve,
+ *      linearly interpolated between the two nearest table entries
+ */
+
+uint16_t apply_curve_fine(curve_type curve, uint16_t level)
+{
+        uint8_t i = level >> 8;
+        uint8_t frac = level & 0xFF;
+        uint16_t lo = apply_curve(curve, i);
+
+        if (frac == 0 || i == 255)
+                return lo;
+
+        uint16_t hi = apply_curve(curve, i + 1);
+
+        return lo + (((uint32_t) (hi - lo) * frac) >> 8);
+}
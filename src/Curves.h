@@ -0,0 +1,90 @@
+  /*
+   * Copyright (C) 2020  Patrick Pedersen, The TU-DO Makespace
+
+   * This program is free software: you can redistribute it and/or modify
+   * it under the terms of the GNU General Public License as published by
+   * the Free Software Foundation, either version 3 of the License, or
+   * (at your option) any later version.
+
+   * This program is distributed in the hope that it will be useful,
+   * but WITHOUT ANY WARRANTY; without even the implied warranty of
+   * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   * GNU General Public License for more details.
+
+   * You should have received a copy of the GNU General Public License
+   * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+   *
+   * Author: Patrick Pedersen <ctx.xda@gmail.com>
+   * Description: Perceptual brightness curves for all light outputs
+   *
+   */
+
+#pragma once
+
+#include <stdint.h>
+
+#define CURVE_OUT_BITS 12 // Resolution of curve outputs
+#define CURVE_OUT_MAX  ((1 << CURVE_OUT_BITS) - 1)
+
+// Levels are 8.8 fixed-point brightness values, allowing
+// transitions to pass between two 8-bit values.
+#define LEVEL_MAX 0xFF00
+
+/* curve_type
+ * ----------
+ * Description:
+ *      Brightness curves which may be applied to an output channel.
+ *      - linear_curve: Values are output as they are
+ *      - gamma_curve: Values are raised to the power of GAMMA (See config.h)
+ *      - cie_curve: Values are treated as CIE 1931 lightness (L*)
+ */
+
+enum curve_type {
+        linear_curve,
+        gamma_curve,
+        cie_curve,
+        num_curves
+};
+
+uint16_t apply_curve(curve_type curve, uint8_t val);
+uint16_t apply_curve_fine(curve_type curve, uint16_t level);
+
+/* byte_to_level
+ * -------------
+ * Arguments:
+ *      val - An 8-bit brightness value
+ * Returns:
+ *      The brightness value as 8.8 fixed-point level
+ */
+
+inline uint16_t byte_to_level(uint8_t val)
+{
+        return (uint16_t) val << 8;
+}
+
+/* level_to_byte
+ * -------------
+ * Arguments:
+ *      level - An 8.8 fixed-point level
+ * Returns:
+ *      The level rounded to an 8-bit brightness value
+ */
+
+inline uint8_t level_to_byte(uint16_t level)
+{
+        return (level >= LEVEL_MAX) ? 255 : (level + 0x80) >> 8;
+}
+
+/* curve_out_to_byte
+ * -----------------
+ * Arguments:
+ *      val - A curve output
+ * Returns:
+ *      The curve output rounded to 8 bits
+ */
+
+inline uint8_t curve_out_to_byte(uint16_t val)
+{
+        val = (val + (1 << (CURVE_OUT_BITS - 9))) >> (CURVE_OUT_BITS - 8);
+        return (val > 255) ? 255 : val;
+}
@@ -0,0 +1,129 @@
+  /*
+   * Copyright (C) 2020  Patrick Pedersen, The TU-DO Makespace
+
+   * This program is free software: you can redistribute it and/or modify
+   * it under the terms of the GNU General Public License as published by
+   * the Free Software Foundation, either version 3 of the License, or
+   * (at your option) any later version.
+
+   * This program is distributed in the hope that it will be useful,
+   * but WITHOUT ANY WARRANTY; without even the implied warranty of
+   * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   * GNU General Public License for more details.
+
+   * You should have received a copy of the GNU General Public License
+   * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+   *
+   * Author: Patrick Pedersen <ctx.xda@gmail.com>
+   * Description: Method/Function definitions for the EventQueue class
+   *
+   */
+
+
+#include <util/atomic.h>
+
+#include "EventQueue.h"
+
+/* EventQueue
+ * ----------
+ * Description:
+ *      Initializes an empty event queue
+ */
+
+EventQueue::EventQueue()
+{
+        _head = 0;
+        _tail = 0;
+        _overflows = 0;
+        _max_latency = 0;
+}
+
+/* EventQueue::push
+ * ----------------
+ * Parameters:
+ *      type - Type of the event
+ *      value - Value of the event
+ *      tstamp - Time (ms) at which the event occurred
+ * Returns:
+ *      True, if the event has been queued, false if the queue is full
+ * Description:
+ *      Queues an event. Must only be called by the producer.
+ */
+
+bool EventQueue::push(uint8_t type, int8_t value, uint16_t tstamp)
+{
+        uint8_t head = _head;
+
+        if ((uint8_t) (head - _tail) == EVENT_QUEUE_SIZE) {
+                _overflows++;
+                return false;
+        }
+
+        input_event &event = _events[head % EVENT_QUEUE_SIZE];
+
+        event.type = type;
+        event.value = value;
+        event.tstamp = tstamp;
+
+        // Publish the event only once it is complete, the barrier keeps
+        // the compiler from moving the stores above past the head update
+        asm volatile ("" ::: "memory");
+        _head = head + 1;
+        return true;
+}
+
+/* EventQueue::pop
+ * ---------------
+ * Parameters:
+ *      event - Return pointer for the oldest event
+ *      now - Current time (ms), to measure the latency of the event
+ * Returns:
+ *      True, if an event has been retrieved, false if the queue is empty
+ * Description:
+ *      Retrieves the oldest event. Must only be called by the consumer.
+ */
+
+bool EventQueue::pop(input_event *event, uint16_t now)
+{
+        uint8_t tail = _tail;
+
+        if (tail == _head)
+                return false;
+
+        *event = _events[tail % EVENT_QUEUE_SIZE];
+        asm volatile ("" ::: "memory");
+        _tail = tail + 1;
+
+        if ((uint16_t) (now - event->tstamp) > _max_latency)
+                _max_latency = now - event->tstamp;
+
+        return true;
+}
+
+/* EventQueue::overflows
+ * ---------------------
+ * Returns:
+ *      The number of events dropped due to a full queue
+ */
+
+uint16_t EventQueue::overflows()
+{
+        uint16_t overflows;
+
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+                overflows = _overflows;
+        }
+
+        return overflows;
+}
+
+/* EventQueue::max_latency
+ * -----------------------
+ * Returns:
+ *      The largest delay (ms) between an event and its retrieval
+ */
+
+uint16_t EventQueue::max_latency()
+{
+        return _max_latency;
+}
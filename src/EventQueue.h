@@ -0,0 +1,77 @@
+  /*
+   * Copyright (C) 2020  Patrick Pedersen, The TU-DO Makespace
+
+   * This program is free software: you can redistribute it and/or modify
+   * it under the terms of the GNU General Public License as published by
+   * the Free Software Foundation, either version 3 of the License, or
+   * (at your option) any later version.
+
+   * This program is distributed in the hope that it will be useful,
+   * but WITHOUT ANY WARRANTY; without even the implied warranty of
+   * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   * GNU General Public License for more details.
+
+   * You should have received a copy of the GNU General Public License
+   * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+   *
+   * Author: Patrick Pedersen <ctx.xda@gmail.com>
+   * Description: A lock-free single producer, single consumer queue for input events
+   *
+   */
+
+
+#pragma once
+
+#include <stdint.h>
+
+#ifndef EVENT_QUEUE_SIZE
+#define EVENT_QUEUE_SIZE 8 // Must be a power of two (max. 128)
+#endif
+
+static_assert((EVENT_QUEUE_SIZE & (EVENT_QUEUE_SIZE - 1)) == 0 && EVENT_QUEUE_SIZE <= 128,
+              "EVENT_QUEUE_SIZE must be a power of two (max. 128)");
+
+/* input_event
+ * -----------
+ * Description:
+ *      A timestamped input event. The meaning of the type and
+ *      value is up to the producer (See PatchEncoder).
+ */
+
+struct input_event {
+        uint8_t type;
+        int8_t value;                           // ex. the number of steps of a rotation
+        uint16_t tstamp;                        // Lower 16 bits of millis() when the event occurred
+};
+
+/*
+ * EventQueue
+ * ----------
+ * Description:
+ *      A ring buffer of input events, filled by exactly one producer (an ISR)
+ *      and drained by exactly one consumer (the main loop). The producer only
+ *      ever writes the head and the consumer only ever writes the tail, both
+ *      8-bit indices that are accessed atomically on AVR, so neither side
+ *      needs to disable interrupts.
+ *
+ *      Events are dropped if the queue is full, which is counted. The
+ *      consumer also tracks the largest delay between an event and its
+ *      retrieval, which indicates whether the queue is drained often enough.
+ */
+
+class EventQueue
+{
+        input_event _events[EVENT_QUEUE_SIZE];
+        volatile uint8_t _head;                 // Next slot to be written, written by the producer only
+        volatile uint8_t _tail;                 // Next slot to be read, written by the consumer only
+        volatile uint16_t _overflows;           // Events dropped due to a full queue, written by the producer only
+        uint16_t _max_latency;                  // Largest delay (ms) between an event and its retrieval
+
+public:
+        EventQueue();
+
+        bool push(uint8_t type, int8_t value, uint16_t tstamp);
+        bool pop(input_event *event, uint16_t now);
+        uint16_t overflows();
+        uint16_t max_latency();
+};
@@ -0,0 +1,377 @@
+  /*
+   * Copyright (C) 2020  Patrick Pedersen, The TU-DO Makespace
+
+   * This program is free software: you can redistribute it and/or modify
+   * it under the terms of the GNU General Public License as published by
+   * the Free Software Foundation, either version 3 of the License, or
+   * (at your option) any later version.
+
+   * This program is distributed in the hope that it will be useful,
+   * but WITHOUT ANY WARRANTY; without even the implied warranty of
+   * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   * GNU General Public License for more details.
+
+   * You should have received a copy of the GNU General Public License
+   * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+   *
+   * Author: Patrick Pedersen <ctx.xda@gmail.com>
+   * Description: Method/Function definitions for the Gesture class
+   *
+   */
+
+
+#include <Arduino.h>
+#include <util/crc16.h>
+
+#include "Gesture.h"
+#include "Curves.h"
+#include "AsyncEEPROM.h"
+
+#define CRC8_INIT 0xFF // Initial CRC value, so zeroed gestures don't pass as valid
+
+/* Gesture
+ * -------
+ * Description:
+ *      Empty constructor for a Gesture object (useful for arrays and pointers)
+ */
+
+Gesture::Gesture()
+{
+
+}
+
+/* Gesture
+ * -------
+ * Parameters:
+ *      addr - EEPROM address of the gesture
+ *      size - Size of the EEPROM region in bytes
+ *      interval - Frames per sample
+ *      deadband - Max deviation of a channel that isn't recorded as movement
+ * Description:
+ *      Initializes a gesture recorder. No gesture is recorded or played.
+ */
+
+Gesture::Gesture(uint16_t addr, uint16_t size, uint8_t interval, uint8_t deadband) :
+_addr(addr), _size(size), _interval(interval), _deadband(deadband), _recording(false), _playing(false)
+{
+
+}
+
+uint16_t Gesture::capacity()
+{
+        return _size - sizeof(gesture_header);
+}
+
+/* Gesture::emit
+ * -------------
+ * Parameters:
+ *      byte - Byte to be appended to the recorded samples
+ * Returns:
+ *      True, if the byte has been written, false if the EEPROM region is full
+ */
+
+bool Gesture::emit(uint8_t byte)
+{
+        if (_header.len >= capacity())
+                return false;
+
+        async_eeprom.write(_addr + sizeof(gesture_header) + _header.len, byte);
+        _header.crc = _crc8_ccitt_update(_header.crc, byte);
+        _header.len++;
+
+        return true;
+}
+
+/* Gesture::flush_hold
+ * -------------------
+ * Returns:
+ *      True, if the pending run of unchanged samples has been written,
+ *      false if the EEPROM region is full
+ */
+
+bool Gesture::flush_hold()
+{
+        if (_hold == 0)
+                return true;
+
+        if (!emit(_hold - 1))
+                return false;
+
+        _hold = 0;
+        return true;
+}
+
+/* Gesture::start_recording
+ * ------------------------
+ * Parameters:
+ *      sample - Current value of every channel
+ * Description:
+ *      Stops any playback and starts a new recording, replacing the stored gesture.
+ */
+
+void Gesture::start_recording(const uint8_t *sample)
+{
+        stop();
+
+        // Invalidate the stored gesture before its samples are overwritten
+        async_eeprom.put(_addr, (uint16_t) 0xFFFF);
+
+        _header.magic = GESTURE_MAGIC;
+        _header.len = 0;
+        _header.crc = CRC8_INIT;
+        memcpy(_header.start, sample, GESTURE_CHANNELS);
+        memcpy(_cur, sample, GESTURE_CHANNELS);
+
+        _hold = 0;
+        _frame = 0;
+        _recording = true;
+}
+
+/* Gesture::record
+ * ---------------
+ * Parameters:
+ *      sample - Current value of every channel
+ * Returns:
+ *      True, if the recording continues
+ *      False, if the EEPROM region is full and the recording must be stopped
+ * Description:
+ *      Must be called once per frame while recording. Every sample interval,
+ *      the channels that moved beyond the deadband are encoded.
+ */
+
+bool Gesture::record(const uint8_t *sample)
+{
+        int16_t deltas[GESTURE_CHANNELS];
+        uint8_t mask = 0;
+        uint8_t n = 0;
+        bool nibbles = true;
+
+        if (!_recording)
+                return false;
+
+        if (++_frame < _interval)
+                return true;
+
+        _frame = 0;
+
+        for (uint8_t c = 0; c < GESTURE_CHANNELS; c++) {
+                int16_t delta = sample[c] - _cur[c];
+
+                if (abs(delta) <= _deadband)
+                        continue;
+
+                mask |= 1 << c;
+                deltas[n++] = delta;
+
+                if (delta < -8 || delta > 7)
+                        nibbles = false;
+        }
+
+        if (mask == 0) {
+                // A new run must leave room for its op, so stop_recording() can always write it
+                if (_hold == 0 && _header.len >= capacity())
+                        return false;
+
+                if (++_hold == GESTURE_MAX_HOLD)
+                        flush_hold();
+
+                return true;
+        }
+
+        if (_header.len + (_hold > 0) + 1 + (nibbles ? (n + 1) / 2 : n) > capacity())
+                return false;
+
+        flush_hold();
+
+        if (nibbles) {
+                emit(GESTURE_OP_NIBBLE | mask);
+
+                for (uint8_t i = 0; i < n; i += 2)
+                        emit((deltas[i] & 0x0F) | (((i + 1 < n) ? (uint8_t) deltas[i + 1] : 0) << 4));
+        } else {
+                emit(GESTURE_OP_DELTA | mask);
+
+                for (uint8_t i = 0; i < n; i++)
+                        emit(deltas[i]);
+        }
+
+        for (uint8_t c = 0; c < GESTURE_CHANNELS; c++) {
+                if (mask & (1 << c))
+                        _cur[c] = sample[c];
+        }
+
+        return true;
+}
+
+/* Gesture::stop_recording
+ * -----------------------
+ * Returns:
+ *      True, if a recording has been stopped and stored
+ * Description:
+ *      Stops the recording and writes the header, which validates the gesture.
+ */
+
+bool Gesture::stop_recording()
+{
+        if (!_recording)
+                return false;
+
+        _recording = false;
+
+        flush_hold();
+        async_eeprom.put(_addr, _header);
+
+        return true;
+}
+
+/* Gesture::recording
+ * ------------------
+ * Returns:
+ *      True, while recording
+ */
+
+bool Gesture::recording()
+{
+        return _recording;
+}
+
+/* Gesture::play
+ * -------------
+ * Returns:
+ *      True, if the playback of the stored gesture has been started
+ *      False, if no valid gesture has been stored
+ */
+
+bool Gesture::play()
+{
+        gesture_header header;
+        uint8_t crc = CRC8_INIT;
+
+        if (_recording)
+                return false;
+
+        async_eeprom.get(_addr, header);
+
+        if (header.magic != GESTURE_MAGIC || header.len > capacity())
+                return false;
+
+        for (uint16_t i = 0; i < header.len; i++)
+                crc = _crc8_ccitt_update(crc, async_eeprom.read(_addr + sizeof(gesture_header) + i));
+
+        if (crc != header.crc)
+                return false;
+
+        _header = header;
+        _pos = 0;
+        _hold = 0;
+        _frame = 0;
+        memcpy(_next, _header.start, GESTURE_CHANNELS);
+        _playing = true;
+
+        return true;
+}
+
+/* Gesture::stop
+ * -------------
+ * Description:
+ *      Stops the playback (ex. when the user takes over control)
+ */
+
+void Gesture::stop()
+{
+        _playing = false;
+}
+
+/* Gesture::playing
+ * ----------------
+ * Returns:
+ *      True, while playing back
+ */
+
+bool Gesture::playing()
+{
+        return _playing;
+}
+
+/* Gesture::next_sample
+ * --------------------
+ * Description:
+ *      Advances playback to the next sample and decodes the sample following it
+ */
+
+void Gesture::next_sample()
+{
+        uint8_t op;
+        uint8_t byte = 0;
+        uint8_t k = 0;
+
+        memcpy(_cur, _next, GESTURE_CHANNELS);
+
+        if (_hold > 0) {
+                _hold--;
+                return;
+        }
+
+        // Loop back to the first sample
+        if (_pos >= _header.len) {
+                _pos = 0;
+                memcpy(_next, _header.start, GESTURE_CHANNELS);
+                return;
+        }
+
+        op = async_eeprom.read(_addr + sizeof(gesture_header) + _pos++);
+
+        if (!(op & GESTURE_OP_DELTA)) {
+                _hold = op;
+                return;
+        }
+
+        for (uint8_t c = 0; c < GESTURE_CHANNELS; c++) {
+                int8_t delta;
+
+                if (!(op & (1 << c)))
+                        continue;
+
+                if ((op & GESTURE_OP_NIBBLE) == GESTURE_OP_NIBBLE) {
+                        if (k++ % 2 == 0) {
+                                byte = async_eeprom.read(_addr + sizeof(gesture_header) + _pos++);
+                                delta = byte & 0x0F;
+                        } else {
+                                delta = byte >> 4;
+                        }
+
+                        // Sign extend the 4-bit delta
+                        if (delta & 0x08)
+                                delta -= 16;
+                } else {
+                        delta = async_eeprom.read(_addr + sizeof(gesture_header) + _pos++);
+                }
+
+                _next[c] += delta;
+        }
+}
+
+/* Gesture::step
+ * -------------
+ * Parameters:
+ *      levels - Return array for the 8.8 fixed-point levels of all channels
+ * Description:
+ *      Must be called once per frame while playing. Interpolates
+ *      between the current and the next sample.
+ */
+
+void Gesture::step(uint16_t *levels)
+{
+        if (_frame == 0)
+                next_sample();
+
+        for (uint8_t c = 0; c < GESTURE_CHANNELS; c++) {
+                int32_t from = byte_to_level(_cur[c]);
+                int32_t to = byte_to_level(_next[c]);
+
+                levels[c] = from + (to - from) * _frame / _interval;
+        }
+
+        if (++_frame >= _interval)
+                _frame = 0;
+}
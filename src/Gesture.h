@@ -0,0 +1,105 @@
+  /*
+   * Copyright (C) 2020  Patrick Pedersen, The TU-DO Makespace
+
+   * This program is free software: you can redistribute it and/or modify
+   * it under the terms of the GNU General Public License as published by
+   * the Free Software Foundation, either version 3 of the License, or
+   * (at your option) any later version.
+
+   * This program is distributed in the hope that it will be useful,
+   * but WITHOUT ANY WARRANTY; without even the implied warranty of
+   * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   * GNU General Public License for more details.
+
+   * You should have received a copy of the GNU General Public License
+   * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+   *
+   * Author: Patrick Pedersen <ctx.xda@gmail.com>
+   * Description: Records potentiometer movements into EEPROM and plays them back in a loop
+   *
+   */
+
+
+#pragma once
+
+#include <stdint.h>
+
+#define GESTURE_CHANNELS 4      // R, G, B and main light
+#define GESTURE_MAGIC    0x4744 // "DG", marks a completely recorded gesture
+
+#define GESTURE_OP_DELTA  0x80  // Op code of a sample with 8-bit deltas, followed by one byte per changed channel
+#define GESTURE_OP_NIBBLE 0xC0  // Op code of a sample with 4-bit deltas, followed by two deltas per byte
+#define GESTURE_MAX_HOLD  0x80  // Longest run of unchanged samples encoded by a single byte
+
+/*
+ * gesture_header
+ * --------------
+ * Description:
+ *      Header in front of the encoded samples of a gesture
+ */
+
+struct gesture_header {
+        uint16_t magic;
+        uint16_t len;                           // Size of the encoded samples in bytes
+        uint8_t start[GESTURE_CHANNELS];        // First sample
+        uint8_t crc;                            // CRC-8 of the encoded samples
+};
+
+/*
+ * Gesture
+ * -------
+ * Description:
+ *      Records the movement of the potentiometers into a region of the EEPROM and
+ *      plays it back in a loop. Every sample interval, the difference to the previous
+ *      sample is encoded into a byte stream:
+ *
+ *      - 0nnnnnnn: The previous sample is repeated n + 1 times
+ *      - 1000mmmm: Followed by an 8-bit delta for every channel set in the mask m
+ *      - 1100mmmm: Followed by 4-bit deltas (-8 to 7) for the channels set in the
+ *        mask m, two per byte, lower nibble first
+ *
+ *      Deviations within the deadband are not recorded, so potentiometer noise
+ *      doesn't interrupt runs of unchanged samples. Samples are written to the
+ *      EEPROM as they're recorded, and the header is written once the recording
+ *      has been stopped, so an interrupted recording never plays back.
+ *
+ *      Playback decodes a single op per sample interval and linearly interpolates
+ *      between samples every frame. When the end is reached, the gesture fades
+ *      back to its first sample and starts over.
+ */
+
+class Gesture
+{
+        uint16_t _addr;                         // EEPROM address of the gesture
+        uint16_t _size;                         // Size of the EEPROM region in bytes
+        uint8_t _interval;                      // Frames per sample
+        uint8_t _deadband;                      // Max deviation that isn't recorded as movement
+
+        bool _recording;                        // True while recording
+        bool _playing;                          // True while playing back
+        gesture_header _header;                 // Header of the recorded/played gesture
+        uint16_t _pos;                          // Offset of the next op
+        uint8_t _hold;                          // Pending repetitions of the current sample
+        uint8_t _frame;                         // Frames since the current sample
+        uint8_t _cur[GESTURE_CHANNELS];         // Current sample
+        uint8_t _next[GESTURE_CHANNELS];        // Next sample (playback only)
+
+        uint16_t capacity();
+        bool emit(uint8_t byte);
+        bool flush_hold();
+        void next_sample();
+
+public:
+        Gesture();
+        Gesture(uint16_t addr, uint16_t size, uint8_t interval, uint8_t deadband);
+
+        void start_recording(const uint8_t *sample);
+        bool record(const uint8_t *sample);
+        bool stop_recording();
+        bool recording();
+
+        bool play();
+        void stop();
+        bool playing();
+        void step(uint16_t *levels);
+};
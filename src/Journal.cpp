@@ -0,0 +1,597 @@
+  /*
+   * Copyright (C) 2020  Patrick Pedersen, The TU-DO Makespace
+
+   * This program is free software: you can redistribute it and/or modify
+   * it under the terms of the GNU General Public License as published by
+   * the Free Software Foundation, either version 3 of the License, or
+   * (at your option) any later version.
+
+   * This program is distributed in the hope that it will be useful,
+   * but WITHOUT ANY WARRANTY; without even the implied warranty of
+   * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   * GNU General Public License for more details.
+
+   * You should have received a copy of the GNU General Public License
+   * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+   *
+   * Author: Patrick Pedersen <ctx.xda@gmail.com>
+   * Description: Method/Function definitions for the Journal class
+   *
+   */
+
+#include <Arduino.h>
+#include <util/crc16.h>
+
+#include "Journal.h"
+#include "AsyncEEPROM.h"
+
+#define JOURNAL_V1_HEADER_SIZE sizeof(uint16_t) // Layout 1 only stored the magic
+#define CRC8_INIT  0xFF   // Initial CRC value, so zeroed records don't pass as valid
+#define CRC16_INIT 0xFFFF // Initial CRC value, so zeroed records don't pass as valid
+
+/* crc8
+ * ----
+ * Arguments:
+ *      data - Data to be checked
+ *      len - Length of the data in bytes
+ * Returns:
+ *      The CRC-8 (CCITT polynomial) of the data
+ */
+
+static uint8_t crc8(const void *data, uint8_t len)
+{
+        const uint8_t *bytes = (const uint8_t *) data;
+        uint8_t crc = CRC8_INIT;
+
+        for (uint8_t i = 0; i < len; i++)
+                crc = _crc8_ccitt_update(crc, bytes[i]);
+
+        return crc;
+}
+
+/* crc16
+ * -----
+ * Arguments:
+ *      crc - CRC of the preceding data (CRC16_INIT for the first chunk)
+ *      data - Data to be checked
+ *      len - Length of the data in bytes
+ * Returns:
+ *      The CRC-16 (IBM polynomial) of the data
+ */
+
+static uint16_t crc16(uint16_t crc, const void *data, uint8_t len)
+{
+        const uint8_t *bytes = (const uint8_t *) data;
+
+        for (uint8_t i = 0; i < len; i++)
+                crc = _crc16_update(crc, bytes[i]);
+
+        return crc;
+}
+
+/* v1_checksum
+ * -----------
+ * Arguments:
+ *      slt - Journal slot
+ * Returns:
+ *      The two's complement of the sum of all slot bytes,
+ *      as used by layout 1 in place of the CRC
+ */
+
+static uint8_t v1_checksum(const journal_slot *slt)
+{
+        const uint8_t *bytes = (const uint8_t *) slt;
+        uint8_t sum = 0;
+
+        for (uint8_t i = 0; i < offsetof(journal_slot, crc); i++)
+                sum += bytes[i];
+
+        return -sum;
+}
+
+static uint16_t record_crc(const journal_record *rec, const void *data)
+{
+        return crc16(crc16(CRC16_INIT, rec, offsetof(journal_record, crc)), data, rec->len);
+}
+
+/* Journal
+ * -------
+ * Description:
+ *      Empty constructor for a Journal object (useful for arrays and pointers)
+ */
+
+Journal::Journal()
+{
+
+}
+
+/* Journal
+ * -------
+ * Parameters:
+ *      addr - EEPROM address of the journal
+ *      size - Size of the journal in bytes
+ *      legacy_size - Size of journals up to layout 3 in bytes
+ * Description:
+ *      Initializes a journal. begin() must be called before accessing records.
+ */
+
+Journal::Journal(uint16_t addr, uint16_t size, uint16_t legacy_size) :
+_addr(addr), _size(size), _legacy_size(legacy_size), _version(JOURNAL_VERSION), _committed(NULL)
+{
+        reset();
+}
+
+uint8_t Journal::header_size()
+{
+        return (_version == 1) ? JOURNAL_V1_HEADER_SIZE : sizeof(journal_header);
+}
+
+uint8_t Journal::unit_size()
+{
+        return (_version < 3) ? sizeof(journal_slot) : JOURNAL_BLOCK_SIZE;
+}
+
+/* Journal::reset
+ * --------------
+ * Description:
+ *      Clears the index and computes the number of blocks/slots of the current layout
+ */
+
+void Journal::reset()
+{
+        uint16_t size = (_version < 4) ? _legacy_size : _size;
+        uint16_t units = (size - header_size()) / unit_size();
+
+        // Block/Slot numbers are 8-bit, with JOURNAL_NO_SLOT being reserved
+        _units = (units < JOURNAL_NO_SLOT) ? units : JOURNAL_NO_SLOT;
+        _head = 0;
+        _seq = 0;
+        memset(_index.start, JOURNAL_NO_SLOT, sizeof(_index.start));
+}
+
+uint16_t Journal::unit_addr(uint8_t unit)
+{
+        return _addr + header_size() + unit * unit_size();
+}
+
+/* Journal::unit_seq
+ * -----------------
+ * Parameters:
+ *      unit - Block/Slot number
+ * Returns:
+ *      The sequence number of the record starting in the block/slot
+ */
+
+uint32_t Journal::unit_seq(uint8_t unit)
+{
+        uint8_t seq[3];
+
+        // Records of all layouts start with the sequence number
+        async_eeprom.read_block(unit_addr(unit), seq, sizeof(seq));
+
+        return seq[0] | ((uint32_t) seq[1] << 8) | ((uint32_t) seq[2] << 16);
+}
+
+/* Journal::overlap
+ * ----------------
+ * Parameters:
+ *      block - First block of a run of blocks
+ *      blocks - Number of blocks
+ * Returns:
+ *      The block following the latest record of a key that overlaps the run,
+ *      or JOURNAL_NO_SLOT if the run doesn't hold the latest record of any key.
+ *      During a transaction, the records it supersedes count as latest as well.
+ */
+
+uint8_t Journal::overlap(uint8_t block, uint8_t blocks)
+{
+        for (uint8_t i = 0; i < 2 * JOURNAL_MAX_KEYS; i++) {
+                const journal_index *index = (i < JOURNAL_MAX_KEYS) ? &_index : _committed;
+                uint8_t key = i % JOURNAL_MAX_KEYS;
+
+                if (!index)
+                        break;
+
+                uint8_t start = index->start[key];
+
+                if (start == JOURNAL_NO_SLOT)
+                        continue;
+
+                uint8_t end = start + index->blocks[key];
+
+                if (start < block + blocks && end > block)
+                        return end;
+        }
+
+        return JOURNAL_NO_SLOT;
+}
+
+/* Journal::read_slot
+ * ------------------
+ * Parameters:
+ *      slot - Slot number
+ *      slt - Return pointer for the fixed size record
+ * Returns:
+ *      True, if the slot holds a valid record of layout 1 or 2
+ */
+
+bool Journal::read_slot(uint8_t slot, journal_slot *slt)
+{
+        async_eeprom.get(unit_addr(slot), *slt);
+
+        return slt->key < JOURNAL_MAX_KEYS &&
+               slt->crc == ((_version == 1) ? v1_checksum(slt) : crc8(slt, offsetof(journal_slot, crc)));
+}
+
+/* Journal::read_record
+ * --------------------
+ * Parameters:
+ *      block - Block number
+ *      rec - Return pointer for the record header
+ *      data - Return pointer for the payload (JOURNAL_MAX_DATA bytes)
+ * Returns:
+ *      True, if a valid record starts in the block
+ */
+
+bool Journal::read_record(uint8_t block, journal_record *rec, void *data)
+{
+        uint8_t buf[sizeof(journal_record) + JOURNAL_MAX_DATA];
+        uint16_t avail = (uint16_t) (_units - block) * JOURNAL_BLOCK_SIZE;
+
+        // Header and payload are read at once, as every read may wait for a pending write
+        async_eeprom.read_block(unit_addr(block), buf, (avail < sizeof(buf)) ? avail : sizeof(buf));
+        memcpy(rec, buf, sizeof(journal_record));
+
+        if (rec->key >= JOURNAL_MAX_KEYS || rec->len > JOURNAL_MAX_DATA ||
+            block + JOURNAL_RECORD_BLOCKS(rec->len) > _units)
+                return false;
+
+        memcpy(data, buf + sizeof(journal_record), rec->len);
+
+        return rec->crc == record_crc(rec, data);
+}
+
+/* Journal::read_unit
+ * ------------------
+ * Parameters:
+ *      unit - Block/Slot number
+ *      key - Return pointer for the key of the record
+ *      units - Return pointer for the number of blocks/slots occupied by the record
+ * Returns:
+ *      True, if a valid record of the loaded layout starts in the block/slot
+ */
+
+bool Journal::read_unit(uint8_t unit, uint8_t *key, uint8_t *units)
+{
+        if (_version < 3) {
+                journal_slot slt;
+
+                if (!read_slot(unit, &slt))
+                        return false;
+
+                *key = slt.key;
+                *units = 1;
+        } else {
+                journal_record rec;
+                uint8_t data[JOURNAL_MAX_DATA];
+
+                if (!read_record(unit, &rec, data))
+                        return false;
+
+                *key = rec.key;
+                *units = JOURNAL_RECORD_BLOCKS(rec.len);
+        }
+
+        return true;
+}
+
+/* Journal::begin
+ * --------------
+ * Returns:
+ *      The state of the journal (See journal_state)
+ * Description:
+ *      Validates the header and checks every block/slot in a single pass to find
+ *      the latest valid record of every key, as well as the latest record overall,
+ *      after which writing continues. Blocks inside of records are checked as well,
+ *      as a record may start inside of an older, superseded one.
+ *      An interrupted transaction is rolled back, after which the journal is reloaded.
+ */
+
+journal_state Journal::begin()
+{
+        journal_header header;
+        bool found = false;
+
+        async_eeprom.get(_addr, header);
+
+        if (header.magic == JOURNAL_MAGIC && header.version <= JOURNAL_VERSION && header.version >= 2 &&
+            header.crc == crc8(&header, offsetof(journal_header, crc)))
+                _version = header.version;
+        else if (header.magic == JOURNAL_V1_MAGIC)
+                _version = 1;
+        else
+                return journal_unformatted;
+
+        reset();
+
+        for (uint8_t unit = 0; unit < _units; unit++) {
+                uint8_t key, units;
+
+                if (!read_unit(unit, &key, &units))
+                        continue;
+
+                uint32_t seq = unit_seq(unit);
+
+                // The sequence number of the current latest record is reread from EEPROM
+                // rather than kept on the stack, which would take 4 bytes per key
+                if (_index.start[key] == JOURNAL_NO_SLOT || seq > unit_seq(_index.start[key])) {
+                        _index.start[key] = unit;
+                        _index.blocks[key] = units;
+                }
+
+                if (!found || seq >= _seq) {
+                        _seq = seq + 1;
+                        _head = (unit + units) % _units;
+                        found = true;
+                }
+        }
+
+        // Only an interrupted transaction leaves its marker behind
+        if (_version == JOURNAL_VERSION && _index.start[JOURNAL_TXN_KEY] != JOURNAL_NO_SLOT) {
+                rollback(unit_seq(_index.start[JOURNAL_TXN_KEY]));
+                return begin();
+        }
+
+        return (_version == JOURNAL_VERSION) ? journal_ok : journal_outdated;
+}
+
+/* Journal::rollback
+ * ------------------
+ * Parameters:
+ *      seq - Sequence number of the marker of a transaction
+ * Description:
+ *      Erases the marker and all records of a transaction, which are
+ *      the records written since, so older records of their keys apply again
+ */
+
+void Journal::rollback(uint32_t seq)
+{
+        for (uint8_t block = 0; block < _units; block++) {
+                uint8_t key, blocks;
+
+                if (read_unit(block, &key, &blocks) && unit_seq(block) >= seq)
+                        async_eeprom.write(unit_addr(block) + offsetof(journal_record, key), JOURNAL_FREE_KEY);
+        }
+}
+
+/* Journal::version
+ * ----------------
+ * Returns:
+ *      The layout version of the loaded journal
+ */
+
+uint8_t Journal::version()
+{
+        return _version;
+}
+
+/* Journal::format
+ * ---------------
+ * Parameters:
+ *      commit - Writes the new header right away. Otherwise the journal can be
+ *               written, but remains unformatted on the EEPROM until commit() is called.
+ * Description:
+ *      Erases all records and marks the EEPROM region as journal of the current layout.
+ *      The old header is invalidated first and the new header is written last, so an
+ *      interrupted format leaves the journal unformatted rather than half valid.
+ *      Records that must not get lost as a whole (ex. while migrating) are written
+ *      before committing, so the journal only becomes valid once all of them are stored.
+ */
+
+void Journal::format(bool commit)
+{
+        async_eeprom.put(_addr, (uint16_t) 0xFFFF);
+
+        _version = JOURNAL_VERSION;
+        reset();
+
+        for (uint8_t block = 0; block < _units; block++)
+                async_eeprom.write(unit_addr(block) + offsetof(journal_record, key), JOURNAL_FREE_KEY);
+
+        if (commit)
+                this->commit();
+}
+
+/* Journal::commit
+ * ---------------
+ * Description:
+ *      Writes the header of a journal formatted with format(false)
+ */
+
+void Journal::commit()
+{
+        journal_header header = { JOURNAL_MAGIC, JOURNAL_VERSION, 0 };
+
+        header.crc = crc8(&header, offsetof(journal_header, crc));
+        async_eeprom.put(_addr, header);
+}
+
+/* Journal::read
+ * -------------
+ * Parameters:
+ *      key - Record key
+ *      data - Return pointer for the payload
+ *      size - Size of the data buffer, longer payloads are truncated
+ *      len - Optional return pointer for the payload size
+ * Returns:
+ *      True, if a valid record has been found for the key
+ * Description:
+ *      Reads the latest record of a key. Records of layouts 1 and 2
+ *      have a payload of JOURNAL_SLOT_DATA bytes.
+ */
+
+bool Journal::read(uint8_t key, void *data, uint8_t size, uint8_t *len)
+{
+        uint8_t buf[JOURNAL_MAX_DATA];
+        uint8_t n;
+
+        if (key >= JOURNAL_MAX_KEYS || _index.start[key] == JOURNAL_NO_SLOT)
+                return false;
+
+        if (_version < 3) {
+                journal_slot slt;
+
+                if (!read_slot(_index.start[key], &slt))
+                        return false;
+
+                n = JOURNAL_SLOT_DATA;
+                memcpy(buf, slt.data, n);
+        } else {
+                journal_record rec;
+
+                if (!read_record(_index.start[key], &rec, buf))
+                        return false;
+
+                n = rec.len;
+        }
+
+        memcpy(data, buf, (n < size) ? n : size);
+
+        if (len)
+                *len = n;
+
+        return true;
+}
+
+/* Journal::write
+ * --------------
+ * Parameters:
+ *      key - Record key
+ *      data - Payload
+ *      len - Payload size in bytes (max. JOURNAL_MAX_DATA)
+ * Returns:
+ *      True, if the record has been written
+ *      False, if the record doesn't fit between the latest records of
+ *      the other keys, or if the journal must be migrated first
+ * Description:
+ *      Appends a new record for the key to the next run of blocks that doesn't
+ *      hold the latest record of any key. Records never wrap around the end of
+ *      the journal. Only bytes that differ from the blocks' previous content
+ *      are written.
+ */
+
+bool Journal::write(uint8_t key, const void *data, uint8_t len)
+{
+        journal_record rec;
+        uint8_t blocks = JOURNAL_RECORD_BLOCKS(len);
+        uint8_t block = _head;
+        uint16_t searched = 0;
+        uint8_t end;
+
+        if (key >= JOURNAL_MAX_KEYS || len > JOURNAL_MAX_DATA || _version != JOURNAL_VERSION)
+                return false;
+
+        while ((end = (block + blocks > _units) ? _units : overlap(block, blocks)) != JOURNAL_NO_SLOT) {
+                searched += end - block;
+                block = end % _units;
+
+                if (searched >= _units)
+                        return false;
+        }
+
+        rec.seq[0] = _seq;
+        rec.seq[1] = _seq >> 8;
+        rec.seq[2] = _seq >> 16;
+        rec.key = key;
+        rec.len = len;
+        rec.crc = record_crc(&rec, data);
+
+        async_eeprom.put(unit_addr(block), rec);
+        async_eeprom.write_block(unit_addr(block) + sizeof(journal_record), data, len);
+
+        _index.start[key] = block;
+        _index.blocks[key] = blocks;
+        _head = (block + blocks) % _units;
+        _seq++;
+
+        return true;
+}
+
+/* Journal::erase
+ * --------------
+ * Parameters:
+ *      key - Record key
+ * Description:
+ *      Erases all records of a key, including the superseded ones, which would
+ *      otherwise apply again. The blocks of the key's latest record become free.
+ */
+
+void Journal::erase(uint8_t key)
+{
+        if (key >= JOURNAL_MAX_KEYS || _index.start[key] == JOURNAL_NO_SLOT || _version != JOURNAL_VERSION)
+                return;
+
+        for (uint8_t block = 0; block < _units; block++) {
+                uint8_t k, blocks;
+
+                if (read_unit(block, &k, &blocks) && k == key)
+                        async_eeprom.write(unit_addr(block) + offsetof(journal_record, key), JOURNAL_FREE_KEY);
+        }
+
+        _index.start[key] = JOURNAL_NO_SLOT;
+}
+
+/* Journal::begin_transaction
+ * --------------------------
+ * Parameters:
+ *      committed - Copy of the index, which must remain valid until the transaction
+ *                  is committed or aborted (ex. on the caller's stack)
+ * Returns:
+ *      True, if the transaction has been opened
+ * Description:
+ *      Opens a transaction by writing its marker. The current index is kept in the
+ *      buffer, so records superseded by the transaction aren't overwritten before it
+ *      is committed. The journal thus needs space for the records of the transaction
+ *      on top of the records they supersede.
+ */
+
+bool Journal::begin_transaction(journal_index *committed)
+{
+        *committed = _index;
+        _committed = committed;
+
+        if (!write(JOURNAL_TXN_KEY, NULL, 0)) {
+                _committed = NULL;
+                return false;
+        }
+
+        return true;
+}
+
+/* Journal::commit_transaction
+ * ---------------------------
+ * Description:
+ *      Erases the marker of the open transaction. As EEPROM writes are performed
+ *      in order, the marker is only erased once all records of the transaction
+ *      are stored.
+ */
+
+void Journal::commit_transaction()
+{
+        async_eeprom.write(unit_addr(_index.start[JOURNAL_TXN_KEY]) + offsetof(journal_record, key), JOURNAL_FREE_KEY);
+        _index.start[JOURNAL_TXN_KEY] = JOURNAL_NO_SLOT;
+        _committed = NULL;
+}
+
+/* Journal::abort_transaction
+ * --------------------------
+ * Description:
+ *      Erases all records of the open transaction, leaving the journal as before
+ */
+
+void Journal::abort_transaction()
+{
+        rollback(unit_seq(_index.start[JOURNAL_TXN_KEY]));
+        _index = *_committed;
+        _committed = NULL;
+}
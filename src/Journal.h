@@ -0,0 +1,180 @@
+  /*
+   * Copyright (C) 2020  Patrick Pedersen, The TU-DO Makespace
+
+   * This program is free software: you can redistribute it and/or modify
+   * it under the terms of the GNU General Public License as published by
+   * the Free Software Foundation, either version 3 of the License, or
+   * (at your option) any later version.
+
+   * This program is distributed in the hope that it will be useful,
+   * but WITHOUT ANY WARRANTY; without even the implied warranty of
+   * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   * GNU General Public License for more details.
+
+   * You should have received a copy of the GNU General Public License
+   * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+   *
+   * Author: Patrick Pedersen <ctx.xda@gmail.com>
+   * Description: A wear leveling, log-structured record journal in EEPROM
+   *
+   */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define JOURNAL_MAGIC      0x4454 // "TD", marks a formatted journal
+#define JOURNAL_VERSION    4      // Current layout version
+#define JOURNAL_V1_MAGIC   0x4A54 // "TJ", marks a layout 1 journal, which predates the header and CRCs
+#define JOURNAL_SLOT_DATA  5      // Payload size of the fixed size records of layouts 1 and 2
+#define JOURNAL_BLOCK_SIZE 4      // Allocation unit of records, records start at block boundaries
+#define JOURNAL_MAX_DATA   32     // Max. payload size of a record
+#define JOURNAL_MAX_KEYS   64     // Number of distinct record keys
+#define JOURNAL_NO_SLOT    0xFF   // Index entry of a key without records
+#define JOURNAL_FREE_KEY   0xFF   // Key of an erased slot/block
+#define JOURNAL_TXN_KEY    (JOURNAL_MAX_KEYS - 3) // Key of the marker of an open transaction, reserved by the journal
+
+/*
+ * journal_header
+ * --------------
+ * Description:
+ *      Header at the start of the journal, identifying its layout
+ */
+
+struct journal_header {
+        uint16_t magic;
+        uint8_t version;
+        uint8_t crc;                            // CRC-8 of the magic and version
+};
+
+/*
+ * journal_state
+ * -------------
+ * Description:
+ *      Outcome of loading a journal
+ *      - journal_ok: The journal is loaded and uses the current layout
+ *      - journal_outdated: The journal is loaded and readable, but uses an older layout
+ *        and must be migrated before writing
+ *      - journal_unformatted: No valid journal header has been found
+ */
+
+enum journal_state {
+        journal_ok,
+        journal_outdated,
+        journal_unformatted
+};
+
+/*
+ * journal_slot
+ * ------------
+ * Description:
+ *      A fixed size record as stored by layouts 1 and 2, which are only read for migration
+ */
+
+struct journal_slot {
+        uint8_t seq[3];                         // Little endian sequence number
+        uint8_t key;                            // Key of the record (ex. patch number)
+        uint8_t data[JOURNAL_SLOT_DATA];        // Payload
+        uint8_t crc;                            // CRC-8, detects torn or corrupted records
+};
+
+/*
+ * journal_record
+ * --------------
+ * Description:
+ *      Header of a record as stored in EEPROM, directly followed by its payload.
+ *      The sequence number is 24 bits wide, which is more than the EEPROM
+ *      endurance allows records to be written, hence sequence numbers never wrap.
+ */
+
+struct journal_record {
+        uint8_t seq[3];                         // Little endian sequence number
+        uint8_t key;                            // Key of the record (ex. patch number)
+        uint8_t len;                            // Payload size in bytes
+        uint16_t crc;                           // CRC-16 of the header and payload, detects torn or corrupted records
+};
+
+// Number of blocks occupied by a record with a payload of len bytes
+#define JOURNAL_RECORD_BLOCKS(len) ((sizeof(journal_record) + (len) + JOURNAL_BLOCK_SIZE - 1) / JOURNAL_BLOCK_SIZE)
+
+// Number of blocks of a journal of size bytes
+#define JOURNAL_BLOCKS(size) (((size) - sizeof(journal_header)) / JOURNAL_BLOCK_SIZE)
+
+/*
+ * journal_index
+ * -------------
+ * Description:
+ *      Location of the latest record of every key, kept in RAM
+ */
+
+struct journal_index {
+        uint8_t start[JOURNAL_MAX_KEYS];        // Block/Slot of the latest record of each key
+        uint8_t blocks[JOURNAL_MAX_KEYS];       // Number of blocks/slots occupied by the latest record of each key
+};
+
+/*
+ * Journal
+ * -------
+ * Description:
+ *      Stores variable size records under a key in a ring of EEPROM blocks.
+ *      Instead of overwriting a key's record in place, every write appends
+ *      a new record with an incremented sequence number at the next run of
+ *      blocks that doesn't hold the latest record of any key, which spreads
+ *      the wear over the whole journal. A key's previous record is thus only
+ *      ever superseded, never overwritten, which makes writes atomic.
+ *
+ *      On begin(), every block is checked once for the start of a valid record,
+ *      recording the block and size of the latest record of every key in RAM, so
+ *      reads are a single index lookup and finding free blocks for a write never
+ *      reads the EEPROM, which would have to wait for pending writes. Journals of older layouts, which
+ *      store fixed size records in slots, remain readable, allowing their
+ *      records to be migrated. Layout 4 only differs from layout 3 in its size,
+ *      as journals up to layout 3 always spanned the rest of the EEPROM
+ *      (the legacy size).
+ *
+ *      Records that must only be stored all together are written in a transaction.
+ *      A marker record is written first and only erased once the last record of the
+ *      transaction is written. Until then, the records superseded by the transaction
+ *      are kept from being overwritten. A marker found by begin() belongs to an
+ *      interrupted transaction, whose records are then erased again.
+ */
+
+class Journal
+{
+        uint16_t _addr;                         // EEPROM address of the journal
+        uint16_t _size;                         // Size of the journal in bytes
+        uint16_t _legacy_size;                  // Size of journals up to layout 3 in bytes
+        uint8_t _version;                       // Layout version of the loaded journal
+        uint8_t _units;                         // Number of blocks (or slots in layouts 1 and 2)
+        journal_index _index;                   // Latest record of each key
+        uint8_t _head;                          // Block/Slot following the latest record
+        uint32_t _seq;                          // Sequence number of the next record
+        journal_index *_committed;              // Index at the start of the open transaction, NULL if none
+
+        uint8_t header_size();
+        uint8_t unit_size();
+        void reset();
+        uint16_t unit_addr(uint8_t unit);
+        uint32_t unit_seq(uint8_t unit);
+        uint8_t overlap(uint8_t block, uint8_t blocks);
+        bool read_slot(uint8_t slot, journal_slot *slt);
+        bool read_record(uint8_t block, journal_record *rec, void *data);
+        bool read_unit(uint8_t unit, uint8_t *key, uint8_t *units);
+        void rollback(uint32_t seq);
+
+public:
+        Journal();
+        Journal(uint16_t addr, uint16_t size, uint16_t legacy_size);
+
+        journal_state begin();
+        uint8_t version();
+        void format(bool commit = true);
+        void commit();
+        bool read(uint8_t key, void *data, uint8_t size, uint8_t *len = NULL);
+        bool write(uint8_t key, const void *data, uint8_t len);
+        void erase(uint8_t key);
+        bool begin_transaction(journal_index *committed);
+        void commit_transaction();
+        void abort_transaction();
+};
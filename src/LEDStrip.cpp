@@ -1,11 +1,20 @@
 #include <LEDStrip.h>
+#include <util/atomic.h>
+
+#ifdef MAIN_STRIP_DITHER
+#if MAIN_STRIP != 5
+#error "MAIN_STRIP_DITHER requires the main strip on pin 5 (OC0B)"
+#endif
+
+static volatile uint16_t main_out; // CURVE_OUT_BITS output of the main strip, dithered by the Timer0 compare B interrupt
+#endif
 
 LEDStrip::LEDStrip()
 {
 
 }
 
-LEDStrip::LEDStrip(uint8_t pin) : _pin(pin)
+LEDStrip::LEDStrip(uint8_t pin) : _pin(pin), _curve(linear_curve)
 {
         pinMode(_pin, OUTPUT);
         set(0);
@@ -13,13 +22,66 @@ LEDStrip::LEDStrip(uint8_t pin) : _pin(pin)
 
 void LEDStrip::set(uint8_t brightness)
 {
-        _brightness = brightness;
-        analogWrite(_pin, _brightness);
+        set_fine(byte_to_level(brightness));
+}
+
+/* LEDStrip::set_fine
+ * ------------------
+ * Arguments:
+ *      level - 8.8 fixed-point brightness before the curve is applied
+ * Description:
+ *      Sets the brightness of the strip. With MAIN_STRIP_DITHER, outputs that lie
+ *      between two 8-bit values are dithered once per PWM period (See ISR below),
+ *      all others are output as plain 8-bit PWM.
+ */
+
+void LEDStrip::set_fine(uint16_t level)
+{
+        uint16_t out;
+
+        _level = level;
+        out = apply_curve_fine(_curve, _level);
+
+#ifdef MAIN_STRIP_DITHER
+        if (out & ((1 << (CURVE_OUT_BITS - 8)) - 1)) {
+                ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+                        main_out = out;
+                }
+
+                // The interrupt connects the pin to the PWM output from the next period on
+                if (!(TIMSK0 & _BV(OCIE0B))) {
+                        digitalWrite(_pin, LOW);
+                        TIMSK0 |= _BV(OCIE0B);
+                }
+
+                return;
+        }
+
+        TIMSK0 &= ~_BV(OCIE0B);
+#endif
+
+        analogWrite(_pin, curve_out_to_byte(out));
 }
 
 uint8_t LEDStrip::get()
 {
-        return _brightness;
+        return level_to_byte(_level);
+}
+
+uint16_t LEDStrip::get_fine()
+{
+        return _level;
+}
+
+void LEDStrip::set_curve(curve_type curve)
+{
+        _curve = curve;
+        set_fine(_level);
+}
+
+curve_type LEDStrip::get_curve()
+{
+        return _curve;
 }
 
 RGBStrip::RGBStrip()
@@ -27,12 +89,219 @@ RGBStrip::RGBStrip()
 
 }
 
+/* bitrev4
+ * -------
+ * Arguments:
+ *      val - A 4-bit value
+ * Returns:
+ *      val with its 4 bits reversed
+ * Description:
+ *      Reversing the bits of a counter yields a sequence in which
+ *      every prefix of length 2^n is spread evenly over 0 - 15.
+ */
+
+static inline uint8_t bitrev4(uint8_t val)
+{
+        return ((val & 1) << 3) | ((val & 2) << 1) | ((val & 4) >> 1) | ((val & 8) >> 3);
+}
+
+/* dither_channel
+ * --------------
+ * Arguments:
+ *      out - A CURVE_OUT_BITS output value
+ *      phase - Dither phase of the pixel/frame
+ * Returns:
+ *      The 8-bit value of the output at the given phase
+ * Description:
+ *      Outputs either the next lower or the next higher 8-bit value, so that
+ *      the average of 16 consecutive phases matches the output value.
+ */
+
+static inline uint8_t dither_channel(uint16_t out, uint8_t phase)
+{
+        uint8_t hi = out >> (CURVE_OUT_BITS - 8);
+        uint8_t frac = out & ((1 << (CURVE_OUT_BITS - 8)) - 1);
+
+        if (hi == 255)
+                return hi;
+
+        return hi + (frac > bitrev4(phase & 0xF));
+}
+
+#ifdef MAIN_STRIP_DITHER
+/* ISR(TIMER0_COMPB_vect)
+ * ----------------------
+ * Description:
+ *      Fires once per PWM period of the main strip (~1 kHz), right after its output
+ *      has been cleared, and sets the 8-bit value of the next period. Since OCR0B is
+ *      double buffered, the new value takes effect at the start of the next period.
+ *      An 8-bit value of 0 can't be output by fast PWM, which still emits a single
+ *      tick, so the pin is disconnected from the timer instead.
+ */
+
+ISR(TIMER0_COMPB_vect)
+{
+        static uint8_t phase;
+        uint8_t val = dither_channel(main_out, phase++);
+
+        if (val) {
+                OCR0B = val;
+                TCCR0A |= _BV(COM0B1);
+        } else {
+                TCCR0A &= ~_BV(COM0B1);
+        }
+}
+#endif
+
+/* dithered
+ * --------
+ * Arguments:
+ *      out - A CURVE_OUT_BITS output value
+ * Returns:
+ *      True if the output lies between two 8-bit values below RGB_STRIP_DITHER,
+ *      false if it is exact, above the limit or if dithering is disabled
+ */
+
+static inline bool dithered(uint16_t out)
+{
+#if defined(RGB_STRIP_DITHER) && RGB_STRIP_TYPE == ADDRESSABLE
+        return (out & ((1 << (CURVE_OUT_BITS - 8)) - 1)) && out < ((uint16_t) RGB_STRIP_DITHER << (CURVE_OUT_BITS - 8));
+#else
+        return false;
+#endif
+}
+
+void RGBStrip::apply_curves()
+{
+        for (uint8_t i = 0; i < 3; i++)
+                _out[i] = apply_curve_fine(_curves[i], _levels[i]);
+
+        _dirty = true;
+}
+
+/* RGBStrip::dithering
+ * -------------------
+ * Returns:
+ *      True if any channel can't be represented by an 8-bit value and
+ *      must be dithered, false otherwise or if dithering is disabled
+ */
+
+bool RGBStrip::dithering()
+{
+        for (uint8_t i = 0; i < 3; i++) {
+                if (dithered(_out[i]))
+                        return true;
+        }
+
+        return false;
+}
+
+/* RGBStrip::dither
+ * ----------------
+ * Arguments:
+ *      phase - Dither phase of the pixel/frame
+ * Returns:
+ *      The color at the given phase, where channels that
+ *      aren't dithered are rounded to their nearest 8-bit value
+ */
+
+RgbColor RGBStrip::dither(uint8_t phase)
+{
+        uint8_t out[3];
+
+        for (uint8_t i = 0; i < 3; i++)
+                out[i] = dithered(_out[i]) ? dither_channel(_out[i], phase) : curve_out_to_byte(_out[i]);
+
+        return RgbColor(out[channel_r], out[channel_g], out[channel_b]);
+}
+
+RgbColor RGBStrip::rounded()
+{
+        return RgbColor(
+                curve_out_to_byte(_out[channel_r]),
+                curve_out_to_byte(_out[channel_g]),
+                curve_out_to_byte(_out[channel_b])
+        );
+}
+
+void RGBStrip::set(RgbColor rgb)
+{
+        set_fine(byte_to_level(rgb.R), byte_to_level(rgb.G), byte_to_level(rgb.B));
+}
+
+/* RGBStrip::set_fine
+ * ------------------
+ * Parameters:
+ *      r - 8.8 fixed-point level of the red channel
+ *      g - 8.8 fixed-point level of the green channel
+ *      b - 8.8 fixed-point level of the blue channel
+ * Description:
+ *      Sets the color with a higher resolution than RgbColor permits.
+ *      The color is output on the next commit() call.
+ */
+
+void RGBStrip::set_fine(uint16_t r, uint16_t g, uint16_t b)
+{
+        _levels[channel_r] = r;
+        _levels[channel_g] = g;
+        _levels[channel_b] = b;
+        apply_curves();
+}
+
+RgbColor RGBStrip::get()
+{
+        return RgbColor(
+                level_to_byte(_levels[channel_r]),
+                level_to_byte(_levels[channel_g]),
+                level_to_byte(_levels[channel_b])
+        );
+}
+
+uint16_t RGBStrip::get_fine(light_channel channel)
+{
+        return _levels[channel];
+}
+
+/* RGBStrip::commit
+ * ----------------
+ * Description:
+ *      Outputs the current color to the strip. This function is meant to be called
+ *      at a fixed frame rate. The strip is only written if the color has changed,
+ *      or if the color must be dithered, in which case a new dither frame is output
+ *      on every call.
+ */
+
+void RGBStrip::commit()
+{
+        bool dither = dithering();
+
+        if (!dither && !_dirty)
+                return;
+
+        write(dither);
+
+        _dirty = false;
+        _frame++;
+}
+
+void RGBStrip::set_curve(light_channel channel, curve_type curve)
+{
+        _curves[channel] = curve;
+        apply_curves();
+}
+
+curve_type RGBStrip::get_curve(light_channel channel)
+{
+        return _curves[channel];
+}
+
 #if RGB_STRIP_TYPE == ADDRESSABLE 
 
-RGBStrip::RGBStrip(unsigned int leds, uint8_t din)
+RGBStrip::RGBStrip(unsigned int leds, uint8_t din) : _levels{0, 0, 0}, _curves{linear_curve, linear_curve, linear_curve}, _frame(0)
 {
         _rgbstrp = new NeoPixelBus <NeoGrbFeature, Neo800KbpsMethod> (leds , din);
         _rgbstrp->Begin();
+        apply_curves();
 }
 
 RGBStrip::~RGBStrip()
@@ -41,22 +310,33 @@ RGBStrip::~RGBStrip()
         _rgbstrp = NULL;
 }
 
-void RGBStrip::set(RgbColor rgb)
-{
-        _rgbstrp->ClearTo(rgb);
-        _rgbstrp->Show();
-}
+/* RGBStrip::write
+ * ---------------
+ * Parameters:
+ *      dither - If true, a dither frame is output, else the rounded color
+ * Description:
+ *      Writes the current color to all pixels. When dithering, the phase of
+ *      every pixel is offset by its position, so that each frame already
+ *      averages to the desired color across the strip.
+ */
 
-RgbColor RGBStrip::get()
+void RGBStrip::write(bool dither)
 {
-        return _rgbstrp->GetPixelColor(0);
+        if (dither) {
+                for (uint16_t i = 0; i < _rgbstrp->PixelCount(); i++)
+                        _rgbstrp->SetPixelColor(i, this->dither(_frame + i));
+        } else {
+                _rgbstrp->ClearTo(rounded());
+        }
+
+        _rgbstrp->Show();
 }
 
 #else
 
-RGBStrip::RGBStrip(uint8_t pin_r, uint8_t pin_g, uint8_t pin_b) : _pin_r(pin_r), _pin_g(pin_g), _pin_b(pin_b)
+RGBStrip::RGBStrip(uint8_t pin_r, uint8_t pin_g, uint8_t pin_b) : _curves{linear_curve, linear_curve, linear_curve}, _frame(0), _pin_r(pin_r), _pin_g(pin_g), _pin_b(pin_b)
 {
-        set(0, 0, 0);        
+        set(RgbColor(0));
 }
 
 RGBStrip::~RGBStrip()
@@ -64,13 +344,13 @@ RGBStrip::~RGBStrip()
         
 }
 
-void RGBStrip::set(RgbColor rgb)
+void RGBStrip::write(bool dither)
 {
-        _rgb = rgb;
-        
-        analogWrite(_pin_r, _rgb.R);
-        analogWrite(_pin_g, _rgb.G);
-        analogWrite(_pin_b, _rgb.B);
-} 
+        RgbColor out = dither ? this->dither(_frame) : rounded();
+
+        analogWrite(_pin_r, out.R);
+        analogWrite(_pin_g, out.G);
+        analogWrite(_pin_b, out.B);
+}
 
 #endif
\ No newline at end of file
@@ -2,27 +2,53 @@
 
 #include <NeoPixelBus.h>
 #include "config.h"
+#include "Curves.h"
 
 #define ADDRESSABLE 0
 #define NON_ADDRESSABLE 1
 
+enum light_channel {
+        channel_r,
+        channel_g,
+        channel_b,
+        channel_m,      // Main light, driven by a LEDStrip
+        num_channels
+};
+
 #ifndef RGB_STRIP_TYPE
 #error "RGB_STRIP_TYPE is undefined. Please specify whether a addressable or non-addressable strip is used!"
 #endif
 
 class LEDStrip {
         uint8_t _pin;
-        uint8_t _brightness;
+        uint16_t _level;        // 8.8 fixed-point brightness before the curve is applied
+        curve_type _curve;
 
 public:
         LEDStrip();
         LEDStrip(uint8_t pin);
 
         void set(uint8_t brightness);
+        void set_fine(uint16_t level);
         uint8_t get();
+        uint16_t get_fine();
+        void set_curve(curve_type curve);
+        curve_type get_curve();
 };
 
 class RGBStrip {
+        uint16_t _levels[3];       // 8.8 fixed-point R, G and B levels before curves are applied
+        curve_type _curves[3];     // Brightness curves of the R, G and B channels
+        uint16_t _out[3];          // CURVE_OUT_BITS output values of the R, G and B channels
+        bool _dirty;               // True if the output has changed since the last commit
+        uint8_t _frame;            // Number of committed frames, used as dither phase
+
+        void apply_curves();
+        bool dithering();
+        RgbColor dither(uint8_t phase);
+        RgbColor rounded();
+        void write(bool dither);
+
 #if RGB_STRIP_TYPE == ADDRESSABLE
         NeoPixelBus <NeoGrbFeature, Neo800KbpsMethod> *_rgbstrp; // Driver for RGB light strip (See https://github.com/Makuna/NeoPixelBus/wiki)
 
@@ -31,14 +57,19 @@ public:
         ~RGBStrip();
 #else
         uint8_t _pin_r, _pin_g, _pin_b;
-        RgbColor _rgb;
 
 public:
         RGBStrip(uint8_t pin_r, uint8_t pin_g, uint8_t b);
+        ~RGBStrip();
 #endif
 
 public:
         RGBStrip();
         void set(RgbColor rgb);
-        RgbColor get();   
+        void set_fine(uint16_t r, uint16_t g, uint16_t b);
+        RgbColor get();
+        uint16_t get_fine(light_channel channel);
+        void commit();
+        void set_curve(light_channel channel, curve_type curve);
+        curve_type get_curve(light_channel channel);
 };
\ No newline at end of file
@@ -0,0 +1,185 @@
+  /*
+   * Copyright (C) 2020  Patrick Pedersen, The TU-DO Makespace
+
+   * This program is free software: you can redistribute it and/or modify
+   * it under the terms of the GNU General Public License as published by
+   * the Free Software Foundation, either version 3 of the License, or
+   * (at your option) any later version.
+
+   * This program is distributed in the hope that it will be useful,
+   * but WITHOUT ANY WARRANTY; without even the implied warranty of
+   * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   * GNU General Public License for more details.
+
+   * You should have received a copy of the GNU General Public License
+   * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+   *
+   * Author: Patrick Pedersen <ctx.xda@gmail.com>
+   * Description: Method/Function definitions for the MovementDetector class
+   *
+   */
+
+#include <Arduino.h>
+
+#include "MovementDetector.h"
+
+/* steps_to_quarters
+ * -----------------
+ * Parameters:
+ *      steps - Deviation in 8-bit steps
+ * Returns:
+ *      The squared deviation in quarter ADC counts
+ */
+
+static uint32_t steps_to_quarters(uint8_t steps)
+{
+        uint32_t q = (uint32_t) steps << 4;
+        return q * q;
+}
+
+/* MovementDetector
+ * ----------------
+ * Description:
+ *      Empty constructor for a MovementDetector object (useful for arrays and pointers)
+ */
+
+MovementDetector::MovementDetector()
+{
+
+}
+
+/* MovementDetector
+ * ----------------
+ * Parameters:
+ *      baseline_shift - Each sample moves the baseline by 1/2^n of its deviation
+ *      noise_shift - Each sample moves the noise variance by 1/2^n of the difference
+ *      sigmas - Threshold in standard deviations of the noise (max. 16)
+ *      floor - Min. threshold in 8-bit steps
+ *      ceiling - Max. threshold in 8-bit steps
+ */
+
+MovementDetector::MovementDetector(uint8_t baseline_shift, uint8_t noise_shift, uint8_t sigmas, uint8_t floor, uint8_t ceiling) :
+_baseline_shift(baseline_shift), _noise_shift(noise_shift)
+{
+        memset(_baseline, 0, sizeof(_baseline));
+        memset(_mean, 0, sizeof(_mean));
+        memset(_variance, 0, sizeof(_variance));
+
+        _ceiling = steps_to_quarters(ceiling);
+        set_sigmas(sigmas);
+        set_floor(floor);
+        _primed = false;
+}
+
+/* MovementDetector::set_sigmas
+ * ----------------------------
+ * Parameters:
+ *      sigmas - Threshold in standard deviations of the noise (max. 16)
+ */
+
+void MovementDetector::set_sigmas(uint8_t sigmas)
+{
+        _sigmas = constrain(sigmas, 1, 16);
+
+        // Divided once here rather than per channel and sample, as AVRs lack a hardware divider
+        _noise_cap = _ceiling / ((uint16_t) _sigmas * _sigmas);
+}
+
+/* MovementDetector::set_floor
+ * ---------------------------
+ * Parameters:
+ *      floor - Min. threshold in 8-bit steps
+ */
+
+void MovementDetector::set_floor(uint8_t floor)
+{
+        _floor = steps_to_quarters(floor);
+}
+
+/* MovementDetector::threshold
+ * ---------------------------
+ * Parameters:
+ *      channel - Channel of the threshold
+ * Returns:
+ *      The squared movement threshold of the channel in quarter ADC counts
+ */
+
+uint32_t MovementDetector::threshold(uint8_t channel)
+{
+        uint32_t noise = _variance[channel] >> 8;
+        uint32_t k = (uint16_t) _sigmas * _sigmas;
+        uint32_t thr;
+
+        // k * noise may overflow for large variances, which are capped anyway
+        thr = (noise >= _noise_cap) ? _ceiling : k * noise;
+
+        return max(thr, _floor);
+}
+
+/* MovementDetector::update
+ * ------------------------
+ * Parameters:
+ *      levels - Low passed levels of all channels in 16-bit fixed point (See PotFilter::level)
+ * Returns:
+ *      A bit mask of the channels which have been moved (bit 0 = R, ..., bit 3 = M)
+ * Description:
+ *      Feeds a sample of every channel through the detector.
+ *      Should be called at a constant rate, as the time constants are given in samples.
+ */
+
+uint8_t MovementDetector::update(const uint16_t *levels)
+{
+        uint8_t moved = 0;
+
+        // Start out at the first sample, assuming the worst noise until the actual noise has been learned
+        if (!_primed) {
+                for (uint8_t i = 0; i < MOVEMENT_CHANNELS; i++) {
+                        _baseline[i] = (uint32_t) (levels[i] >> 4) << 16;
+                        _mean[i] = _baseline[i];
+                        _variance[i] = _noise_cap << 8;
+                }
+
+                _primed = true;
+        }
+
+        for (uint8_t i = 0; i < MOVEMENT_CHANNELS; i++) {
+                int16_t q = levels[i] >> 4;
+                uint32_t x = (uint32_t) q << 16;
+                int16_t dev = q - (int16_t) ((_baseline[i] + 0x8000) >> 16);
+                int16_t noise = q - (int16_t) ((_mean[i] + 0x8000) >> 16);
+                uint32_t dev2 = (int32_t) dev * dev;
+                uint32_t noise2 = min((uint32_t) ((int32_t) noise * noise), _ceiling);
+
+                if (dev2 > threshold(i)) {
+                        _baseline[i] = x;
+                        moved |= 1 << i;
+                } else {
+                        _baseline[i] += ((int32_t) (x - _baseline[i])) >> _baseline_shift;
+                }
+
+                _mean[i] += ((int32_t) (x - _mean[i])) >> MOVEMENT_MEAN_SHIFT;
+                _variance[i] += ((int32_t) ((noise2 << 8) - _variance[i])) >> _noise_shift;
+        }
+
+        return moved;
+}
+
+/* MovementDetector::noise_floor
+ * -----------------------------
+ * Parameters:
+ *      channel - Channel of the threshold
+ * Returns:
+ *      The current movement threshold of the channel in ADC counts
+ */
+
+uint16_t MovementDetector::noise_floor(uint8_t channel)
+{
+        uint32_t thr = threshold(channel);
+        uint16_t root = 0;
+
+        // Integer square root, the threshold is small enough to count up to it
+        while ((uint32_t) (root + 1) * (root + 1) <= thr)
+                root++;
+
+        return root >> 2;
+}
@@ -0,0 +1,76 @@
+  /*
+   * Copyright (C) 2020  Patrick Pedersen, The TU-DO Makespace
+
+   * This program is free software: you can redistribute it and/or modify
+   * it under the terms of the GNU General Public License as published by
+   * the Free Software Foundation, either version 3 of the License, or
+   * (at your option) any later version.
+
+   * This program is distributed in the hope that it will be useful,
+   * but WITHOUT ANY WARRANTY; without even the implied warranty of
+   * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   * GNU General Public License for more details.
+
+   * You should have received a copy of the GNU General Public License
+   * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+   *
+   * Author: Patrick Pedersen <ctx.xda@gmail.com>
+   * Description: Adaptive movement detection for potentiometers
+   *
+   */
+
+#pragma once
+
+#include <stdint.h>
+
+#define MOVEMENT_CHANNELS   4 // R, G, B and M potentiometer
+#define MOVEMENT_MEAN_SHIFT 4 // Each sample moves the short-term mean by 1/2^n of its deviation
+
+/*
+ * MovementDetector
+ * ----------------
+ * Description:
+ *      Tells real potentiometer movement apart from noise and drift.
+ *
+ *      Every channel keeps a baseline, which slowly follows the low passed
+ *      potentiometer level, and an estimate of the noise variance (an exponential
+ *      moving average of the squared deviation from a short-term mean). The noise
+ *      is measured against the short-term mean rather than the baseline, so that
+ *      slow turns, which the baseline lags behind, aren't mistaken for noise.
+ *      A channel is considered moved once its deviation from the baseline exceeds
+ *      the threshold, which is a number of standard deviations of the noise,
+ *      but never less than the floor and never more than the ceiling.
+ *
+ *      Samples within the threshold update the baseline, so temperature drift is
+ *      tracked over time, while the noise estimate follows changing supply noise.
+ *      Samples past the threshold are reported immediately and re-anchor the
+ *      baseline at the new position.
+ *
+ *      To avoid square roots, the deviations are compared squared, in quarter
+ *      ADC counts (the 16-bit fixed point level shifted right by 4).
+ */
+
+class MovementDetector
+{
+        uint32_t _baseline[MOVEMENT_CHANNELS];  // Baselines in quarter ADC counts, 16.16 fixed point
+        uint32_t _mean[MOVEMENT_CHANNELS];      // Short-term means in quarter ADC counts, 16.16 fixed point
+        uint32_t _variance[MOVEMENT_CHANNELS];  // Noise variances in quarter ADC counts squared, 24.8 fixed point
+        uint8_t _baseline_shift;                // Each sample moves the baseline by 1/2^n of the deviation
+        uint8_t _noise_shift;                   // Each sample moves the variance by 1/2^n of the difference
+        uint8_t _sigmas;                        // Threshold in standard deviations of the noise
+        uint32_t _floor;                        // Squared min. threshold
+        uint32_t _ceiling;                      // Squared max. threshold
+        uint32_t _noise_cap;                    // Variance at which the threshold reaches the ceiling (_ceiling / _sigmas^2)
+        bool _primed;                           // False until the first sample
+
+        uint32_t threshold(uint8_t channel);
+
+public:
+        MovementDetector();
+        MovementDetector(uint8_t baseline_shift, uint8_t noise_shift, uint8_t sigmas, uint8_t floor, uint8_t ceiling);
+
+        void set_sigmas(uint8_t sigmas);
+        void set_floor(uint8_t floor);
+        uint8_t update(const uint16_t *levels);
+        uint16_t noise_floor(uint8_t channel);
+};
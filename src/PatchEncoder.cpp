@@ -1,46 +1,137 @@
+#include <Arduino.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
 #include "PatchEncoder.h"
 
+static PatchEncoder *encoder_instance = NULL;
+
+void encoder_tick()
+{
+        encoder_instance->tick();
+}
+
+// Timer0 keeps millis() and fires its compare A interrupt once per
+// millisecond, independently of the PWM duty cycle of pin 6
+ISR(TIMER0_COMPA_vect)
+{
+        encoder_tick();
+}
+
 PatchEncoder::PatchEncoder()
 {
 
 }
 
-PatchEncoder::PatchEncoder(uint8_t dt, uint8_t clk, uint8_t sw, unsigned long debounce_time) : _debounce_time(debounce_time)
+PatchEncoder::PatchEncoder(uint8_t dt, uint8_t clk, uint8_t sw, uint8_t transitions, unsigned long accel_time, uint8_t accel_max,
+                           uint16_t debounce_time, uint16_t long_press_time, uint16_t double_click_time) :
+_rotary_enc(clk, dt, transitions, accel_time, accel_max), _long_press_time(long_press_time), _double_click_time(double_click_time)
 {
-        _debounce = false;
-        _sw = PushButton(sw, true);
-        _rotary_enc = new Encoder(dt, clk);
-        _pos = _rotary_enc->read();
+        _steps = 0;
+        _long_pressed = false;
+        _click_pending = false;
+        _press_tstamp = 0;
+        _release_tstamp = 0;
+        _sw = PushButton(sw, true, debounce_time); // Sampled once per ms
 }
 
-PatchEncoder::~PatchEncoder()
+void PatchEncoder::begin()
 {
-        delete _rotary_enc;
-        _rotary_enc = NULL;
+        _rotary_enc.begin();
+
+        encoder_instance = this;
+        OCR0A = 0x80;
+        TIMSK0 |= _BV(OCIE0A);
+}
+
+void PatchEncoder::set_debounce_time(uint16_t debounce_time)
+{
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+                _sw.set_debounce_samples(debounce_time);
+        }
+}
+
+void PatchEncoder::tick()
+{
+        uint16_t now = millis();
+        int8_t steps = _rotary_enc.steps();
+
+        if (steps != 0)
+                _events.push(turned, steps, now);
+
+        if (_sw.sample()) {
+                if (_sw.pressed()) {
+                        _events.push(pressed, 0, now);
+                        _press_tstamp = now;
+                        _long_pressed = false;
+                        return;
+                }
+
+                _events.push(released, 0, now);
+
+                // Releasing a long press doesn't count as click
+                if (_long_pressed) {
+                        return;
+                } else if (_click_pending) {
+                        _events.push(double_clicked, 0, now);
+                        _click_pending = false;
+                } else {
+                        _click_pending = true;
+                        _release_tstamp = now;
+                }
+        } else if (_sw.pressed()) {
+                if (!_long_pressed && (uint16_t) (now - _press_tstamp) >= _long_press_time) {
+                        _events.push(long_pressed, 0, now);
+                        _long_pressed = true;
+                        _click_pending = false;
+                }
+        } else if (_click_pending && (uint16_t) (now - _release_tstamp) >= _double_click_time) {
+                // No second click followed in time
+                _events.push(clicked, 0, now);
+                _click_pending = false;
+        }
 }
 
 encoder_action PatchEncoder::action()
 {
-        if (_debounce && millis() >= _debounce_tstamp) {
-                encoder_action ret = no_action;
-                _debounce = false;
-
-                long read = _rotary_enc->read();
-                
-                if (read > _pos)
-                        ret = right;
-                else if (read < _pos)
-                        ret = left;
-
-                _pos = read;
-
-                return ret;
-        } else if (!_debounce && _rotary_enc->read() != _pos) {
-                _debounce = true;
-                _debounce_tstamp = millis() + _debounce_time;
-        } else if (_sw.released()) {
-                return pressed;
+        input_event event;
+
+        if (!_events.pop(&event, millis()))
+                return no_action;
+
+        if (event.type == turned)
+                _steps = event.value;
+
+        return (encoder_action) event.type;
+}
+
+int8_t PatchEncoder::steps()
+{
+        return _steps;
+}
+
+// Debounced state of the push button, true while it is held down
+bool PatchEncoder::held()
+{
+        return _sw.pressed();
+}
+
+// Treats the press in progress as an already reported long press, so it
+// yields neither a long press nor a click until the button is released
+void PatchEncoder::ignore_press()
+{
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+                _long_pressed = true;
+                _click_pending = false;
         }
+}
 
-        return no_action;
+uint16_t PatchEncoder::overflows()
+{
+        return _events.overflows();
+}
+
+uint16_t PatchEncoder::max_latency()
+{
+        return _events.max_latency();
 }
\ No newline at end of file
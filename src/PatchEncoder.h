@@ -1,30 +1,50 @@
 #pragma once
 
-#include <Encoder.h>
-
 #include "PushButton.h"
+#include "QuadratureEncoder.h"
+#include "EventQueue.h"
 
 enum encoder_action {
         no_action,
         pressed,
-        left,
-        right
+        released,
+        clicked,
+        double_clicked,
+        long_pressed,
+        turned
 };
 
+// Input events are gathered by tick(), which is called by a 1 kHz timer
+// interrupt and is the only producer of the event queue. action() is
+// called by the main loop and is the only consumer.
 class PatchEncoder {
         PushButton _sw;
-        Encoder *_rotary_enc;
+        QuadratureEncoder _rotary_enc;
+        EventQueue _events;
         
-        unsigned long _debounce_time;
-        long _pos;
+        uint16_t _long_press_time;
+        uint16_t _double_click_time;
+        uint16_t _press_tstamp;
+        uint16_t _release_tstamp;
+        bool _long_pressed;
+        bool _click_pending;
+
+        int8_t _steps;
 
-        bool _debounce;
-        unsigned long _debounce_tstamp;
+        void tick();
+        friend void encoder_tick();
         
 public:
         PatchEncoder();
-        PatchEncoder(uint8_t clk, uint8_t dt, uint8_t sw, unsigned long debounce_time);
-        ~PatchEncoder();
+        PatchEncoder(uint8_t dt, uint8_t clk, uint8_t sw, uint8_t transitions, unsigned long accel_time, uint8_t accel_max,
+                     uint16_t debounce_time, uint16_t long_press_time, uint16_t double_click_time);
 
+        void begin();
+        void set_debounce_time(uint16_t debounce_time);
         encoder_action action();
+        int8_t steps();
+        bool held();
+        void ignore_press();
+        uint16_t overflows();
+        uint16_t max_latency();
 };
\ No newline at end of file
@@ -46,12 +46,13 @@ PatchIndicator::PatchIndicator()
  *      e - Pin of e segment
  *      f - Pin of f segment
  *      g - Pin of g segment
+ *      dp - Pin of the decimal point
  * Description:
  *      Initializes 7-segment patch indicator
  */
 
 PatchIndicator::PatchIndicator(bool config, uint8_t common, uint8_t a, uint8_t b, uint8_t c, uint8_t d, uint8_t e, uint8_t f, uint8_t g, uint8_t dp) :
-_config(config), _common(common)
+_config(config), _common(common), _dp(dp)
 {
         _segments[0] = a;
         _segments[1] = b;
@@ -63,13 +64,16 @@ _config(config), _common(common)
 
         pinMode(_common, OUTPUT);
         
-        pinMode(dp, OUTPUT);
-        digitalWrite(dp, (_config == COMMON_CATHODE) ? LOW : HIGH);
+        pinMode(_dp, OUTPUT);
+        set_dp(false);
         
         for (uint8_t i = 0; i < 7; i++)
                 pinMode(_segments[i], OUTPUT);
 
         select(false);
+
+        _show_timer = timers.add();
+        _blink_timer = timers.add();
 }
 
 /* PatchIndicator::set
@@ -86,6 +90,49 @@ void PatchIndicator::set(uint8_t dig)
                 digitalWrite(_segments[i], (_config == COMMON_CATHODE) ? digits[dig][i] : !digits[dig][i]);
 }
 
+/* PatchIndicator::set_bank
+ * -------------------------
+ * Parameters:
+ *      bank - Bank number to be blinked by the decimal point
+ * Description:
+ *      Sets the bank shown by the decimal point while a digit is displayed
+ */
+
+void PatchIndicator::set_bank(uint8_t bank)
+{
+        _bank = bank;
+}
+
+/* PatchIndicator::set_dp
+ * ----------------------
+ * Parameters:
+ *      lit - If true, the decimal point is lit
+ */
+
+void PatchIndicator::set_dp(bool lit)
+{
+        _dp_state = lit;
+        digitalWrite(_dp, (_config == COMMON_CATHODE) ? lit : !lit);
+}
+
+/* PatchIndicator::update_dp
+ * -------------------------
+ * Description:
+ *      Outputs the bank code on the decimal point. The code consists of
+ *      one blink per bank, repeated after a pause for as long as the
+ *      digit is displayed.
+ */
+
+void PatchIndicator::update_dp()
+{
+        const unsigned long blink = DP_BLINK_ON + DP_BLINK_OFF;
+        unsigned long phase = (millis() - _show_start) % (_bank * blink + DP_BLINK_PAUSE);
+        bool lit = (_bank > 0 && phase < _bank * blink && phase % blink < DP_BLINK_ON);
+
+        if (lit != _dp_state)
+                set_dp(lit);
+}
+
 /* PatchIndicator::select
  * ----------------------
  * Parameters:
@@ -140,7 +187,9 @@ void PatchIndicator::show(unsigned long duration)
         _blinks = 0;
         _show = true;
         select(true);
-        _show_tstamp = millis() + duration;
+        _show_start = millis();
+        timers.stop(_blink_timer);
+        timers.start(_show_timer, duration);
         _busy = true;
 }
 
@@ -157,11 +206,13 @@ void PatchIndicator::show(unsigned long duration)
 void PatchIndicator::blink(uint8_t blinks, unsigned long interval_on, unsigned long interval_off)
 {
         _show = false;
+        set_dp(false);
         _blinks = blinks;
         _blink_interval_on = interval_on;
         _blink_interval_off = interval_off;
         select(true);
-        _blink_tstamp = millis() + interval_on;
+        timers.stop(_show_timer);
+        timers.start(_blink_timer, interval_on);
         _busy = true;
 }
 
@@ -174,21 +225,26 @@ void PatchIndicator::blink(uint8_t blinks, unsigned long interval_on, unsigned l
  */
 
 void PatchIndicator::update() {
-        if (_show && _show_tstamp <= millis())
+        if (_show && timers.expired(_show_timer))
         {
                 select(false);
+                set_dp(false);
                 _show = false;
                 _busy = false;
         }
-        else if (_blinks > 0 && _blink_tstamp <= millis())
+        else if (_show)
+        {
+                update_dp();
+        }
+        else if (_blinks > 0 && timers.expired(_blink_timer))
         {
                 toggle();
 
                 if (_state == false) {
-                        _blink_tstamp = millis() + _blink_interval_off;
+                        timers.start(_blink_timer, _blink_interval_off);
                         _blinks--;
                 } else {
-                        _blink_tstamp = millis() + _blink_interval_on;
+                        timers.start(_blink_timer, _blink_interval_on);
                 }
 
                 _busy = (_blinks > 0);
@@ -23,9 +23,21 @@
 
 #include <stdint.h>
 
+#include "Timers.h"
+
 #define COMMON_ANODE 0
 #define COMMON_CATHODE 1
 
+#ifndef DP_BLINK_ON
+#define DP_BLINK_ON    150 // ms, On time of a bank code blink
+#endif
+#ifndef DP_BLINK_OFF
+#define DP_BLINK_OFF   250 // ms, Off time of a bank code blink
+#endif
+#ifndef DP_BLINK_PAUSE
+#define DP_BLINK_PAUSE 750 // ms, Pause between repetitions of the bank code
+#endif
+
 /*
  * PatchIndicator
  * --------------
@@ -33,6 +45,8 @@
  *      A driver class for the 7-segment patch indicator display.
  *      This class can display a digit for a given duration using the display() function,
  *      as well as flash a digit n times for a given duration, using the display() function.
+ *      While a digit is displayed, the decimal point blinks the number of the active
+ *      bank (ex. 2 blinks for bank 2) and remains dark for bank 0.
  */
 
 class PatchIndicator
@@ -85,25 +99,32 @@ class PatchIndicator
         bool _config;                   // Stores whether the 7 segment display is a common anode(0) or common cathode(1) display
         uint8_t _common;                // Pin of common anode or cathode
         uint8_t _segments[7];           // Pins of all segments (a to g)
+        uint8_t _dp;                    // Pin of the decimal point
+        bool _dp_state = false;         // True if the decimal point is lit
+        uint8_t _bank = 0;              // Bank number blinked by the decimal point
 
         bool _busy = false;             // True if patch indicator is scheduled
 
         bool _show = false;             // True if patch indicator is tasked to display a number
-        unsigned long _show_tstamp;     // Timestamp for displaying digits
+        timer_id _show_timer;           // Expires when the digit is to be turned off
+        unsigned long _show_start;      // Timestamp at which the digit was shown, start of the bank code
 
 
         uint8_t _blinks;                                       // Number of blinks the patch indicator should perform
         unsigned long _blink_interval_on, _blink_interval_off; // Duration of on and off intervals for blinks
-        unsigned long _blink_tstamp;                           // Timestamp for blink intervals
+        timer_id _blink_timer;                                 // Expires at the end of a blink interval
 
         void select(bool select);
         void toggle();
+        void set_dp(bool lit);
+        void update_dp();
 
 public:
         PatchIndicator();
         PatchIndicator(bool config, uint8_t common, uint8_t a, uint8_t b, uint8_t c, uint8_t d, uint8_t e, uint8_t f, uint8_t g, uint8_t dp);
 
         void set(uint8_t num);
+        void set_bank(uint8_t bank);
         bool busy();
         void update();
         void blink(uint8_t blinks, unsigned long interval_on, unsigned long interval_off);
@@ -0,0 +1,237 @@
+  /*
+   * Copyright (C) 2020  Patrick Pedersen, The TU-DO Makespace
+
+   * This program is free software: you can redistribute it and/or modify
+   * it under the terms of the GNU General Public License as published by
+   * the Free Software Foundation, either version 3 of the License, or
+   * (at your option) any later version.
+
+   * This program is distributed in the hope that it will be useful,
+   * but WITHOUT ANY WARRANTY; without even the implied warranty of
+   * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   * GNU General Public License for more details.
+
+   * You should have received a copy of the GNU General Public License
+   * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+   *
+   * Author: Patrick Pedersen <ctx.xda@gmail.com>
+   * Description: Method/Function definitions for the PotFilter class
+   *
+   */
+
+
+#include <Arduino.h>
+
+#include "PotFilter.h"
+
+/* PotFilter
+ * ---------
+ * Description:
+ *      Empty constructor for a PotFilter object (useful for arrays and pointers)
+ */
+
+PotFilter::PotFilter()
+{
+
+}
+
+/* PotFilter
+ * ---------
+ * Parameters:
+ *      config - Parameters of the filter chain
+ */
+
+PotFilter::PotFilter(pot_filter_config config) : _config(config)
+{
+        _config.median = constrain(_config.median, 1, POT_FILTER_MAX_MEDIAN);
+        _config.oversampling = min(_config.oversampling, POT_FILTER_MAX_OVERSAMPLING);
+        _top = (1 << (8 + _config.oversampling)) - 1;
+        _lower_bound = 0;
+        _gain = POT_FILTER_UNITY_GAIN;
+        _bias = 0;
+        _raw = 0;
+        _next = 0;
+        _lowpass = 0;
+        _out = 0;
+        _primed = false;
+}
+
+/* PotFilter::set_lower_bound
+ * --------------------------
+ * Parameters:
+ *      lower_bound - Outputs less and equal to the lower bound are returned as 0
+ */
+
+void PotFilter::set_lower_bound(uint8_t lower_bound)
+{
+        _lower_bound = lower_bound;
+}
+
+/* PotFilter::set_range
+ * ---------------------
+ * Parameters:
+ *      low - Reading (left aligned) at the lower end of the potentiometer
+ *      high - Reading (left aligned) at the upper end of the potentiometer
+ * Description:
+ *      Calibrates the filter to the potentiometer, so readings from low to high
+ *      span the full scale. The range must span more than a quarter of the scale,
+ *      narrower ranges leave the readings unchanged, as does a range of 0 to
+ *      POT_FILTER_FULL_SCALE.
+ */
+
+void PotFilter::set_range(uint16_t low, uint16_t high)
+{
+        if (high <= (uint32_t) low + (POT_FILTER_FULL_SCALE >> 2)) {
+                _gain = POT_FILTER_UNITY_GAIN;
+                _bias = 0;
+                return;
+        }
+
+        _gain = ((uint32_t) POT_FILTER_FULL_SCALE * POT_FILTER_UNITY_GAIN) / (high - low);
+        _bias = (uint32_t) low * _gain;
+}
+
+/* PotFilter::median
+ * -----------------
+ * Returns:
+ *      The median of the sample window
+ */
+
+uint16_t PotFilter::median()
+{
+        uint16_t sorted[POT_FILTER_MAX_MEDIAN];
+        uint8_t n = _config.median;
+
+        // Insertion sort, the window holds 5 samples at most
+        for (uint8_t i = 0; i < n; i++) {
+                uint16_t s = _window[i];
+                uint8_t j = i;
+
+                for (; j > 0 && sorted[j - 1] > s; j--)
+                        sorted[j] = sorted[j - 1];
+
+                sorted[j] = s;
+        }
+
+        return sorted[n / 2];
+}
+
+/* PotFilter::update
+ * -----------------
+ * Parameters:
+ *      sample - ADC reading of 10 + n bits (See oversampling), left aligned to 16 bits
+ * Returns:
+ *      The filtered 8-bit value
+ * Description:
+ *      Feeds a sample through the filter chain
+ */
+
+uint8_t PotFilter::update(uint16_t sample)
+{
+        uint32_t cal = (uint32_t) sample * _gain;
+        uint16_t x;
+        uint32_t hyst = (uint32_t) _config.deadband << 6;
+        uint8_t shift = 8 - _config.oversampling; // 16-bit fixed point to output steps
+        uint32_t lp;
+
+        _raw = sample;
+
+        // Calibration, clamped to the full scale
+        if (cal <= _bias)
+                x = 0;
+        else
+                x = min((cal - _bias) >> 14, (uint32_t) POT_FILTER_FULL_SCALE);
+
+        // Start out settled on the first sample
+        if (!_primed) {
+                for (uint8_t i = 0; i < _config.median; i++)
+                        _window[i] = x;
+
+                _lowpass = x;
+                _out = x >> shift;
+                _primed = true;
+        }
+
+        _window[_next] = x;
+        _next = (_next + 1) % _config.median;
+        x = median();
+
+        _lowpass += ((int32_t) x - _lowpass) >> _config.iir_shift;
+        lp = _lowpass;
+
+        // Leave the current step only when moving past its borders by more than the deadband.
+        // The deadband would keep the outer steps of finer outputs out of reach, hence
+        // the ends are snapped to once the low pass is within half of the deadband.
+        if (lp + (hyst >> 1) >= POT_FILTER_FULL_SCALE)
+                _out = _top;
+        else if (lp <= (hyst >> 1))
+                _out = 0;
+        else if (_out < _top && lp >= ((uint32_t) (_out + 1) << shift) + hyst)
+                _out = (lp - hyst) >> shift;
+        else if (lp + hyst < ((uint32_t) _out << shift))
+                _out = (lp + hyst) >> shift;
+
+        return value();
+}
+
+/* PotFilter::value
+ * ----------------
+ * Returns:
+ *      The last filtered 8-bit value
+ */
+
+uint8_t PotFilter::value()
+{
+        uint8_t out = _out >> _config.oversampling;
+
+        return (out <= _lower_bound) ? 0 : out;
+}
+
+/* PotFilter::fine
+ * ---------------
+ * Returns:
+ *      The last filtered value as 8.8 fixed-point level (0xFF00 = full scale),
+ *      with the full output resolution of 8 + n bits
+ */
+
+uint16_t PotFilter::fine()
+{
+        if (value() == 0)
+                return 0;
+
+        return ((uint32_t) _out * 0xFF00) / _top;
+}
+
+/* PotFilter::level
+ * ----------------
+ * Returns:
+ *      The state of the low pass in 16-bit fixed point (the reading, left aligned)
+ */
+
+uint16_t PotFilter::level()
+{
+        return _lowpass;
+}
+
+/* PotFilter::oversampling
+ * -----------------------
+ * Returns:
+ *      The extra bits of resolution to be gained by oversampling, meaning
+ *      the filter must be fed with the average of 4^n conversions
+ */
+
+uint8_t PotFilter::oversampling()
+{
+        return _config.oversampling;
+}
+
+/* PotFilter::raw
+ * --------------
+ * Returns:
+ *      The last sample as fed to the filter, before calibration
+ */
+
+uint16_t PotFilter::raw()
+{
+        return _raw;
+}
@@ -0,0 +1,102 @@
+  /*
+   * Copyright (C) 2020  Patrick Pedersen, The TU-DO Makespace
+
+   * This program is free software: you can redistribute it and/or modify
+   * it under the terms of the GNU General Public License as published by
+   * the Free Software Foundation, either version 3 of the License, or
+   * (at your option) any later version.
+
+   * This program is distributed in the hope that it will be useful,
+   * but WITHOUT ANY WARRANTY; without even the implied warranty of
+   * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   * GNU General Public License for more details.
+
+   * You should have received a copy of the GNU General Public License
+   * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+   *
+   * Author: Patrick Pedersen <ctx.xda@gmail.com>
+   * Description: A fixed-point filter chain for potentiometer readings
+   *
+   */
+
+
+#pragma once
+
+#include <stdint.h>
+
+#define POT_FILTER_MAX_MEDIAN       5 // Largest median window
+#define POT_FILTER_MAX_OVERSAMPLING 3 // Max. extra bits gained by oversampling (64 conversions)
+#define POT_FILTER_FULL_SCALE       0xFFC0 // Largest reading, left aligned (1023 << 6)
+#define POT_FILTER_UNITY_GAIN       0x4000 // Gain of 1 in 2.14 fixed point
+
+/*
+ * pot_filter_config
+ * -----------------
+ * Description:
+ *      Parameters of a potentiometer filter chain
+ */
+
+struct pot_filter_config {
+        uint8_t median;                 // Median window in samples (1 = off, 3 or 5)
+        uint8_t iir_shift;              // Each sample moves the low pass by 1/2^n of the remaining distance (0 = off)
+        uint8_t deadband;               // Noise in ADC counts that doesn't change the output (0 = off)
+        uint8_t oversampling;           // Extra bits of resolution gained by averaging 4^n conversions per sample
+};
+
+/*
+ * PotFilter
+ * ---------
+ * Description:
+ *      Filters the ADC readings of a potentiometer down to a steady value with a
+ *      resolution of 8 + n bits, n being the extra bits gained by oversampling.
+ *      Every sample passes the following stages, all in 16-bit fixed point
+ *      (the 10 + n bit reading, left aligned):
+ *
+ *      - Calibration: The range between the readings at both ends of the potentiometer
+ *        is stretched to the full scale, by a single fixed-point multiply-add.
+ *      - Median: The median of the last samples, which removes single spikes
+ *        without delaying steps.
+ *      - IIR low pass: An exponential moving average, which smooths the remaining noise.
+ *      - Hysteresis: The output only changes once the low pass has moved past the
+ *        current output step by more than the deadband, so noise around the
+ *        border of two steps doesn't make the output toggle.
+ *      - Lower bound gate: Outputs less and equal to the lower bound are returned as 0.
+ *
+ *      The output can be read as 8-bit value, or as 8.8 fixed-point level, which
+ *      retains the full output resolution for the high resolution light outputs.
+ *
+ *      Filters should be fed at a constant rate, as the low pass time constant is
+ *      given in samples.
+ */
+
+class PotFilter
+{
+        pot_filter_config _config;
+        uint8_t _lower_bound;                   // Lower bound of the gate (8-bit)
+        uint16_t _gain;                         // Calibration gain (2.14 fixed point)
+        uint32_t _bias;                         // Calibration offset, premultiplied by the gain
+
+        uint16_t _raw;                          // Last uncalibrated sample
+
+        uint16_t _window[POT_FILTER_MAX_MEDIAN];// Last samples for the median
+        uint8_t _next;                          // Next sample of the window to be replaced
+        uint16_t _lowpass;                      // State of the IIR low pass
+        uint16_t _out;                          // Output step (8 + n bits), before the gate
+        uint16_t _top;                          // Largest output step
+        bool _primed;                           // False until the first sample
+
+        uint16_t median();
+
+public:
+        PotFilter();
+        PotFilter(pot_filter_config config);
+
+        void set_lower_bound(uint8_t lower_bound);
+        void set_range(uint16_t low, uint16_t high);
+        uint8_t update(uint16_t sample);
+        uint8_t value();
+        uint16_t fine();
+        uint16_t level();
+        uint8_t oversampling();
+        uint16_t raw();
+};
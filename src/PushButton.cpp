@@ -27,10 +27,16 @@ PushButton::PushButton()
         
 }
 
-PushButton::PushButton(uint8_t pin, bool pullup) : _pin(pin) , _pullup(pullup)
+PushButton::PushButton(uint8_t pin, bool pullup, uint16_t debounce_samples) : _pin(pin) , _pullup(pullup), _debounce_samples(debounce_samples)
 {
         pinMode(pin, (pullup) ? INPUT_PULLUP : INPUT);
-        _prev_state = state();
+        _pressed = state();
+        _bounce = 0;
+}
+
+void PushButton::set_debounce_samples(uint16_t samples)
+{
+        _debounce_samples = samples;
 }
 
 bool PushButton::state()
@@ -38,15 +44,26 @@ bool PushButton::state()
         return _pullup ? !digitalRead(_pin) : digitalRead(_pin); 
 }
 
-bool PushButton::released()
+// Samples the button once, the debounced state only changes
+// once the button has been read in the new state for more
+// than the given number of consecutive samples.
+// Returns true if the debounced state has changed.
+bool PushButton::sample()
 {
-        bool current_state = state();
-
-        if (current_state == false && _prev_state == true) {
-                _prev_state = false;
-                return true;
+        if (state() == _pressed) {
+                _bounce = 0;
+                return false;
         }
-        
-        _prev_state = current_state;
-        return false;
+
+        if (_bounce++ < _debounce_samples)
+                return false;
+
+        _pressed = !_pressed;
+        _bounce = 0;
+        return true;
+}
+
+bool PushButton::pressed()
+{
+        return _pressed;
 }
\ No newline at end of file
@@ -27,11 +27,15 @@ class PushButton
 {
     uint8_t _pin;
     bool _pullup;
-    bool _prev_state;
+    bool _pressed;
+    uint16_t _bounce;
+    uint16_t _debounce_samples;
     
 public:    
     PushButton();
-    PushButton(uint8_t pin, bool pullup);
+    PushButton(uint8_t pin, bool pullup, uint16_t debounce_samples = 0);
+    void set_debounce_samples(uint16_t samples);
     bool state();
-    bool released();
+    bool sample();
+    bool pressed();
 };
\ No newline at end of file
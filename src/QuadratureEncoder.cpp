@@ -0,0 +1,174 @@
+  /*
+   * Copyright (C) 2020  Patrick Pedersen, The TU-DO Makespace
+
+   * This program is free software: you can redistribute it and/or modify
+   * it under the terms of the GNU General Public License as published by
+   * the Free Software Foundation, either version 3 of the License, or
+   * (at your option) any later version.
+
+   * This program is distributed in the hope that it will be useful,
+   * but WITHOUT ANY WARRANTY; without even the implied warranty of
+   * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   * GNU General Public License for more details.
+
+   * You should have received a copy of the GNU General Public License
+   * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+   *
+   * Author: Patrick Pedersen <ctx.xda@gmail.com>
+   * Description: Method/Function definitions for the QuadratureEncoder class
+   *
+   */
+
+#include <Arduino.h>
+#include <avr/pgmspace.h>
+
+#include "QuadratureEncoder.h"
+
+// Quarter step of every transition, indexed by (previous state << 2 | current state).
+// Unchanged states and invalid transitions, where both phases changed, count as 0.
+static const int8_t quad_table[16] PROGMEM = {
+         0, -1,  1,  0,
+         1,  0,  0, -1,
+        -1,  0,  0,  1,
+         0,  1, -1,  0
+};
+
+static QuadratureEncoder *quad_instance = NULL; // Instance served by the pin change ISR
+
+/* quad_isr
+ * --------
+ * Description:
+ *      Forwards the pin change interrupts of both phases to the active QuadratureEncoder instance
+ */
+
+void quad_isr()
+{
+        quad_instance->isr();
+}
+
+/* QuadratureEncoder
+ * -----------------
+ * Description:
+ *      Empty constructor for a QuadratureEncoder object (useful for arrays and pointers)
+ */
+
+QuadratureEncoder::QuadratureEncoder()
+{
+
+}
+
+/* QuadratureEncoder
+ * -----------------
+ * Parameters:
+ *      a - Pin of the A phase
+ *      b - Pin of the B phase
+ *      transitions - Phase transitions per detent (usually 4)
+ *      accel_time - Max time (ms) between two detents for them to be accelerated
+ *      accel_max - Max acceleration factor (1 = no acceleration)
+ * Description:
+ *      Initializes a quadrature decoder for the provided pins.
+ *      The decoder remains idle until begin() is called.
+ */
+
+QuadratureEncoder::QuadratureEncoder(uint8_t a, uint8_t b, uint8_t transitions, unsigned long accel_time, uint8_t accel_max) :
+_a(a), _b(b), _transitions(transitions), _accel_time(accel_time), _accel_max(accel_max)
+{
+        _a_port = portInputRegister(digitalPinToPort(a));
+        _b_port = portInputRegister(digitalPinToPort(b));
+        _a_mask = digitalPinToBitMask(a);
+        _b_mask = digitalPinToBitMask(b);
+
+        _state = 0;
+        _quarter = 0;
+        _count = 0;
+        _read = 0;
+        _step_tstamp = 0;
+}
+
+/* QuadratureEncoder::phases
+ * -------------------------
+ * Returns:
+ *      The current state of both phases (A << 1 | B)
+ */
+
+uint8_t QuadratureEncoder::phases()
+{
+        return ((*_a_port & _a_mask) ? 2 : 0) | ((*_b_port & _b_mask) ? 1 : 0);
+}
+
+/* QuadratureEncoder::begin
+ * ------------------------
+ * Description:
+ *      Enables the pull-ups of both pins and attaches the pin change ISR.
+ *      Must be called from setup(), once the Arduino core is initialized.
+ */
+
+void QuadratureEncoder::begin()
+{
+        pinMode(_a, INPUT_PULLUP);
+        pinMode(_b, INPUT_PULLUP);
+
+        _state = phases();
+        _step_tstamp = millis();
+
+        quad_instance = this;
+        attachInterrupt(digitalPinToInterrupt(_a), quad_isr, CHANGE);
+        attachInterrupt(digitalPinToInterrupt(_b), quad_isr, CHANGE);
+}
+
+/* QuadratureEncoder::steps
+ * ------------------------
+ * Returns:
+ *      The number of steps since the last call, positive if the A phase leads
+ *      (clockwise for most encoders), negative otherwise
+ * Description:
+ *      Collects the detents counted by the ISR since the last call and
+ *      multiplies them by the acceleration factor, which is the acceleration
+ *      time divided by the time since the previous detent (max. accel_max).
+ *      Should be polled frequently, as at most 127 detents can be buffered.
+ */
+
+int8_t QuadratureEncoder::steps()
+{
+        uint8_t count = _count;
+        int8_t detents = (int8_t) (count - _read);
+        unsigned long now = millis();
+        unsigned long factor;
+
+        if (detents == 0)
+                return 0;
+
+        _read = count;
+        factor = _accel_time / max(now - _step_tstamp, 1UL);
+        _step_tstamp = now;
+
+        factor = constrain(factor, 1, _accel_max);
+
+        return constrain(detents * (int16_t) factor, -127, 127);
+}
+
+/* QuadratureEncoder::isr
+ * ----------------------
+ * Description:
+ *      Advances the quarter step counter by the transition from the last to the
+ *      current phase state and counts a detent once a full detent has been turned.
+ *      Called by the pin change ISR of both phases.
+ */
+
+void QuadratureEncoder::isr()
+{
+        uint8_t state = phases();
+        int8_t quarter = _quarter + (int8_t) pgm_read_byte(&quad_table[(_state << 2) | state]);
+
+        _state = state;
+
+        if (quarter >= _transitions) {
+                _count++;
+                quarter = 0;
+        } else if (quarter <= -_transitions) {
+                _count--;
+                quarter = 0;
+        }
+
+        _quarter = quarter;
+}
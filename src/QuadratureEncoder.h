@@ -0,0 +1,77 @@
+  /*
+   * Copyright (C) 2020  Patrick Pedersen, The TU-DO Makespace
+
+   * This program is free software: you can redistribute it and/or modify
+   * it under the terms of the GNU General Public License as published by
+   * the Free Software Foundation, either version 3 of the License, or
+   * (at your option) any later version.
+
+   * This program is distributed in the hope that it will be useful,
+   * but WITHOUT ANY WARRANTY; without even the implied warranty of
+   * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   * GNU General Public License for more details.
+
+   * You should have received a copy of the GNU General Public License
+   * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+   *
+   * Author: Patrick Pedersen <ctx.xda@gmail.com>
+   * Description: An interrupt driven quadrature decoder for rotary encoders
+   *
+   */
+
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * QuadratureEncoder
+ * -----------------
+ * Description:
+ *      Decodes the two phases of a rotary encoder in the pin change ISR of both
+ *      pins using a state transition table. Valid transitions move a quarter step
+ *      counter by one, while contact bounce merely moves it back and forth, and
+ *      invalid (skipped) transitions are ignored. Every time the counter reaches
+ *      the number of transitions per detent, a detent is counted.
+ *
+ *      Detents are counted by a free running 8-bit counter, which the ISR only
+ *      ever writes and the main loop only ever reads. As 8-bit accesses are atomic
+ *      on AVR, steps() can poll the counter without disabling interrupts and
+ *      computes the steps taken since its last call from the difference.
+ *
+ *      Fast turns are accelerated: if a detent follows the previous one within
+ *      the acceleration time, it counts as multiple steps, up to a maximum factor.
+ *
+ *      Only one instance may exist, as both pins are served by a single ISR.
+ *      Both pins must support external interrupts (pins 2 and 3 on the ATmega328).
+ */
+
+class QuadratureEncoder
+{
+        uint8_t _a;                                     // Pin of the A phase
+        uint8_t _b;                                     // Pin of the B phase
+        volatile uint8_t *_a_port;                      // Input register of the A phase
+        volatile uint8_t *_b_port;                      // Input register of the B phase
+        uint8_t _a_mask;
+        uint8_t _b_mask;
+        int8_t _transitions;                            // Transitions per detent
+
+        uint8_t _state;                                 // Last phase state (A << 1 | B), ISR only
+        int8_t _quarter;                                // Transitions since the last detent, ISR only
+        volatile uint8_t _count;                        // Free running detent counter, written by the ISR only
+
+        uint8_t _read;                                  // Detent counter at the last call of steps()
+        unsigned long _step_tstamp;                     // Timestamp of the last detent
+        unsigned long _accel_time;                      // Max time (ms) between accelerated detents
+        uint8_t _accel_max;                             // Max acceleration factor
+
+        uint8_t phases();
+        void isr();
+        friend void quad_isr();                         // Pin change ISR trampoline
+
+public:
+        QuadratureEncoder();
+        QuadratureEncoder(uint8_t a, uint8_t b, uint8_t transitions, unsigned long accel_time, uint8_t accel_max);
+
+        void begin();
+        int8_t steps();
+};
@@ -0,0 +1,98 @@
+  /*
+   * Copyright (C) 2020  Patrick Pedersen, The TU-DO Makespace
+
+   * This program is free software: you can redistribute it and/or modify
+   * it under the terms of the GNU General Public License as published by
+   * the Free Software Foundation, either version 3 of the License, or
+   * (at your option) any later version.
+
+   * This program is distributed in the hope that it will be useful,
+   * but WITHOUT ANY WARRANTY; without even the implied warranty of
+   * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   * GNU General Public License for more details.
+
+   * You should have received a copy of the GNU General Public License
+   * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+   *
+   * Author: Patrick Pedersen <ctx.xda@gmail.com>
+   * Description: Method/Function definitions for the SlewLimiter class
+   *
+   */
+
+#include "SlewLimiter.h"
+
+/* SlewLimiter
+ * -----------
+ * Description:
+ *      Empty constructor for a SlewLimiter object (useful for arrays and pointers)
+ */
+
+SlewLimiter::SlewLimiter()
+{
+
+}
+
+/* SlewLimiter
+ * -----------
+ * Parameters:
+ *      rates - Maximum change per frame of each channel (8.8 fixed-point)
+ *      smoothing - IIR filter coefficient, each frame moves 1/2^smoothing of the
+ *                  remaining distance (0 disables smoothing)
+ * Description:
+ *      Initializes a slew rate limiter with all levels at 0
+ */
+
+SlewLimiter::SlewLimiter(const uint16_t *rates, uint8_t smoothing) : _smoothing(smoothing)
+{
+        for (uint8_t i = 0; i < SLEW_CHANNELS; i++) {
+                _levels[i] = 0;
+                _rates[i] = rates[i];
+        }
+}
+
+/* SlewLimiter::reset
+ * ------------------
+ * Parameters:
+ *      levels - Levels to continue from
+ * Description:
+ *      Sets the current levels without limiting (ex. to the currently
+ *      output levels when the potentiometers take over control)
+ */
+
+void SlewLimiter::reset(const uint16_t *levels)
+{
+        for (uint8_t i = 0; i < SLEW_CHANNELS; i++)
+                _levels[i] = levels[i];
+}
+
+/* SlewLimiter::step
+ * -----------------
+ * Parameters:
+ *      targets - Levels to move towards
+ *      levels - Return array for the limited levels
+ * Description:
+ *      Advances all levels by one frame towards their targets
+ */
+
+void SlewLimiter::step(const uint16_t *targets, uint16_t *levels)
+{
+        for (uint8_t i = 0; i < SLEW_CHANNELS; i++) {
+                bool up = targets[i] > _levels[i];
+                uint16_t dist = up ? targets[i] - _levels[i] : _levels[i] - targets[i];
+                uint16_t step = dist >> _smoothing;
+
+                if (step > _rates[i])
+                        step = _rates[i];
+                else if (step < SLEW_MIN_STEP)
+                        step = SLEW_MIN_STEP;
+
+                if (step >= dist)
+                        _levels[i] = targets[i];
+                else if (up)
+                        _levels[i] += step;
+                else
+                        _levels[i] -= step;
+
+                levels[i] = _levels[i];
+        }
+}
@@ -0,0 +1,52 @@
+  /*
+   * Copyright (C) 2020  Patrick Pedersen, The TU-DO Makespace
+
+   * This program is free software: you can redistribute it and/or modify
+   * it under the terms of the GNU General Public License as published by
+   * the Free Software Foundation, either version 3 of the License, or
+   * (at your option) any later version.
+
+   * This program is distributed in the hope that it will be useful,
+   * but WITHOUT ANY WARRANTY; without even the implied warranty of
+   * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   * GNU General Public License for more details.
+
+   * You should have received a copy of the GNU General Public License
+   * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+   *
+   * Author: Patrick Pedersen <ctx.xda@gmail.com>
+   * Description: Slew rate limiting and smoothing of potentiometer driven levels
+   *
+   */
+
+#pragma once
+
+#include <stdint.h>
+
+#define SLEW_CHANNELS 4     // R, G, B and main light
+#define SLEW_MIN_STEP 0x10  // Smallest step per frame (8.8 fixed-point), bounds the settling time
+
+/*
+ * SlewLimiter
+ * -----------
+ * Description:
+ *      Smooths a set of 8.8 fixed-point levels towards their targets.
+ *      Every frame, each level moves by 1/2^smoothing of its remaining distance
+ *      (a first order IIR filter), but by no more than the channel's maximum rate
+ *      and no less than SLEW_MIN_STEP. Hence, a level settles within
+ *      (distance / rate) frames plus a short exponential tail.
+ */
+
+class SlewLimiter
+{
+        uint16_t _levels[SLEW_CHANNELS];        // Current levels
+        uint16_t _rates[SLEW_CHANNELS];         // Maximum change per frame of each channel
+        uint8_t _smoothing;                     // IIR filter coefficient as power of two
+
+public:
+        SlewLimiter();
+        SlewLimiter(const uint16_t *rates, uint8_t smoothing);
+
+        void reset(const uint16_t *levels);
+        void step(const uint16_t *targets, uint16_t *levels);
+};
@@ -0,0 +1,167 @@
+  /*
+   * Copyright (C) 2020  Patrick Pedersen, The TU-DO Makespace
+
+   * This program is free software: you can redistribute it and/or modify
+   * it under the terms of the GNU General Public License as published by
+   * the Free Software Foundation, either version 3 of the License, or
+   * (at your option) any later version.
+
+   * This program is distributed in the hope that it will be useful,
+   * but WITHOUT ANY WARRANTY; without even the implied warranty of
+   * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   * GNU General Public License for more details.
+
+   * You should have received a copy of the GNU General Public License
+   * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+   *
+   * Author: Patrick Pedersen <ctx.xda@gmail.com>
+   * Description: Method/Function definitions for the TimerService class
+   *
+   */
+
+
+#include <Arduino.h>
+
+#include "Timers.h"
+
+TimerService timers; // Zero initialized, see TimerService
+
+/* due
+ * ---
+ * Parameters:
+ *      deadline - Deadline of a timer
+ *      now - Current time
+ * Returns:
+ *      True, if the deadline has been reached
+ * Description:
+ *      Wrap-safe deadline comparison
+ */
+
+static inline bool due(unsigned long deadline, unsigned long now)
+{
+        return (long) (now - deadline) >= 0;
+}
+
+/* TimerService::add
+ * -----------------
+ * Returns:
+ *      The id of a new, stopped timer, or TIMER_NONE if all MAX_TIMERS timers are taken
+ */
+
+timer_id TimerService::add()
+{
+        if (_count == MAX_TIMERS)
+                return TIMER_NONE;
+
+        _timers[_count].running = false;
+        return _count++;
+}
+
+/* TimerService::start
+ * -------------------
+ * Parameters:
+ *      id - Timer id
+ *      timeout - Time in ms until the timer expires
+ *      periodic - If true, the timer expires every timeout ms until stopped
+ * Description:
+ *      (Re)starts a timer
+ */
+
+void TimerService::start(timer_id id, unsigned long timeout, bool periodic)
+{
+        if (id >= _count)
+                return;
+
+        _timers[id].deadline = millis() + timeout;
+        _timers[id].period = periodic ? timeout : 0;
+        _timers[id].running = true;
+}
+
+/* TimerService::stop
+ * ------------------
+ * Parameters:
+ *      id - Timer id
+ */
+
+void TimerService::stop(timer_id id)
+{
+        if (id < _count)
+                _timers[id].running = false;
+}
+
+/* TimerService::running
+ * ---------------------
+ * Parameters:
+ *      id - Timer id
+ * Returns:
+ *      True, if the timer has been started and hasn't expired (one-shot) or been stopped
+ */
+
+bool TimerService::running(timer_id id)
+{
+        return id < _count && _timers[id].running;
+}
+
+/* TimerService::expired
+ * ---------------------
+ * Parameters:
+ *      id - Timer id
+ * Returns:
+ *      True, once per expiry of the timer
+ * Description:
+ *      Checks whether a timer has expired. One-shot timers stop on expiry.
+ *      Periodic timers advance to their next deadline, keeping their pace
+ *      regardless of how late they are polled. Should they fall behind by
+ *      more than a period, the missed expiries are dropped.
+ */
+
+bool TimerService::expired(timer_id id)
+{
+        unsigned long now = millis();
+
+        if (id >= _count)
+                return false;
+
+        software_timer &timer = _timers[id];
+
+        if (!timer.running || !due(timer.deadline, now))
+                return false;
+
+        if (timer.period == 0) {
+                timer.running = false;
+                return true;
+        }
+
+        timer.deadline += timer.period;
+
+        if (due(timer.deadline, now))
+                timer.deadline = now + timer.period;
+
+        return true;
+}
+
+/* TimerService::next_due
+ * ----------------------
+ * Returns:
+ *      The time in ms until the next timer expires (0 if a timer has already
+ *      expired), or TIMER_IDLE if no timer is running
+ */
+
+unsigned long TimerService::next_due()
+{
+        unsigned long now = millis();
+        unsigned long next = TIMER_IDLE;
+
+        for (uint8_t i = 0; i < _count; i++) {
+                if (!_timers[i].running)
+                        continue;
+
+                if (due(_timers[i].deadline, now))
+                        return 0;
+
+                if (_timers[i].deadline - now < next)
+                        next = _timers[i].deadline - now;
+        }
+
+        return next;
+}
@@ -0,0 +1,78 @@
+  /*
+   * Copyright (C) 2020  Patrick Pedersen, The TU-DO Makespace
+
+   * This program is free software: you can redistribute it and/or modify
+   * it under the terms of the GNU General Public License as published by
+   * the Free Software Foundation, either version 3 of the License, or
+   * (at your option) any later version.
+
+   * This program is distributed in the hope that it will be useful,
+   * but WITHOUT ANY WARRANTY; without even the implied warranty of
+   * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   * GNU General Public License for more details.
+
+   * You should have received a copy of the GNU General Public License
+   * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+   *
+   * Author: Patrick Pedersen <ctx.xda@gmail.com>
+   * Description: A wrap-safe deadline timer service shared by all firmware modules
+   *
+   */
+
+
+#pragma once
+
+#include <stdint.h>
+
+#define MAX_TIMERS 8            // Max. number of registered timers
+#define TIMER_NONE 0xFF         // Returned by add() if all timers are taken
+#define TIMER_IDLE 0xFFFFFFFF   // Returned by next_due() if no timer is running
+
+typedef uint8_t timer_id;
+
+/*
+ * software_timer
+ * --------------
+ * Description:
+ *      A registered timer
+ */
+
+struct software_timer {
+        unsigned long deadline;         // millis() at which the timer expires
+        unsigned long period;           // Period of periodic timers, 0 for one-shot timers
+        bool running;
+};
+
+/*
+ * TimerService
+ * ------------
+ * Description:
+ *      Keeps the deadlines of all one-shot and periodic timeouts of the firmware.
+ *      Modules register their timers once with add() and poll them with expired().
+ *
+ *      Deadlines are never compared directly, but by the sign of their difference
+ *      to the current time, which remains correct when millis() wraps around after
+ *      ~49.7 days, as long as no timeout exceeds ~24.8 days.
+ *
+ *      As all timeouts are known to the service, next_due() tells for how long
+ *      nothing is scheduled, so idle periods can be slept through.
+ *
+ *      The service has no constructor, so timers can be registered from the
+ *      constructors of other global objects, regardless of initialization order.
+ */
+
+class TimerService
+{
+        software_timer _timers[MAX_TIMERS];
+        uint8_t _count;                 // Number of registered timers
+
+public:
+        timer_id add();
+        void start(timer_id id, unsigned long timeout, bool periodic = false);
+        void stop(timer_id id);
+        bool running(timer_id id);
+        bool expired(timer_id id);
+        unsigned long next_due();
+};
+
+extern TimerService timers;
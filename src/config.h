@@ -22,6 +22,7 @@
 #pragma once
 
 #include "PatchIndicator.h"
+#include "Curves.h"
 
 ///////////////////////////
 // Hardware Parameters
@@ -42,18 +43,31 @@
 // #define NO_MAIN_STRIP // No main LED strip present,
                          // defining this will prevent noise from toggling potentiometer movement detection
 #define MAIN_STRIP     5
+#define MAIN_STRIP_DITHER // Dithers the 8-bit PWM of the main strip, so the main light is dimmed in ~1024 steps (~10 bits,
+                          // set by the oversampled main pot) instead of 256. The PWM value is changed every PWM period
+                          // (~1 kHz), so the dither cycle repeats at ~60 Hz and isn't visible as flicker.
+                          // Requires the main strip on pin 5 (OC0B), comment out for any other pin.
 
 // Addressable Strips (NeoPixel/WS2812)
 #define RGB_STRIP_TYPE ADDRESSABLE
 #define RGB_STRIP      A1
 #define RGB_STRIP_LEDS 30 // Number of LEDs/Pixels on the RGB strip
+#define RGB_STRIP_DITHER 32 // Temporally dithers RGB channels below this 8-bit level to the 12-bit resolution
+                            // of the brightness curves, where the 8-bit steps are visible. Every dithered frame
+                            // is sent to the strip, which masks interrupts for ~30 us per LED at FRAME_RATE.
+                            // Comment out if the dithering is visible as flicker.
 
 // Non-Addressable Strips (Replace XX with free PWM pins)
+// PWM outputs are never dithered, as the dither cycle would flicker at FRAME_RATE / 16.
 // #define RGB_STRIP_TYPE NON_ADDRESSABLE
 // #define RGB_STRIP_A    XX
 // #define RGB_STRIP_G    XX
 // #define RGB_STRIP_B    XX
 
+// Additional mono strips (Replace XX with any free pins, PWM capable or not)
+// The strips are dimmed using Bit Angle Modulation, which occupies Timer1.
+// #define BAM_STRIPS     XX, XX // Pins of additional main light zones
+
 /* 7-Segment Patch Indicator */
 #define SEV_SEG_COMMON_MODE COMMON_ANODE
 #define SEV_SEG_A      11
@@ -70,15 +84,85 @@
 // Firmware parameters
 ///////////////////////////
 
+// Parameters marked with [s] are defaults, which can be changed at runtime via
+// the serial console without reflashing (See README, Tuning settings)
+
+/* Output */
+#define FRAME_RATE 100 // Rate (Hz) at which the light outputs are refreshed
+
+/* Power */
+// Sleeps the CPU whenever no timer is due. Any interrupt wakes it up again,
+// at the latest the millis() tick of Timer0 every ~1 ms, which bounds the input latency.
+#define IDLE_SLEEP
+#define IDLE_REPORT_INTERVAL 1000 // Time (ms) over which the idle time is averaged
+
 /* Rotary Encoder */
-#define ROTARY_ENC_DEBOUCE_TIME 250
+#define ROTARY_ENC_DEBOUCE_TIME 30  // [s] Time (ms) the push button must remain in a new state before the change is accepted
+#define LONG_PRESS_TIME         1000 // Time (ms) the push button must be held down to save a patch
+#define DOUBLE_CLICK_TIME       300  // Max time (ms) between the two clicks of a double click
+#define ROTARY_ENC_TRANSITIONS  4   // Phase transitions per detent
+#define ROTARY_ENC_ACCEL_TIME   100 // Max time (ms) between two detents for them to be accelerated
+#define ROTARY_ENC_ACCEL_MAX    4   // Max number of patches skipped per detent when turning fast (1 = no acceleration)
 
 /* Potentiometers */
-#define POT_MOV_DET_AVG_SAMPLES 100
-#define POT_MOV_DET_MAX_DEV     6
+#define POT_SAMPLE_INTERVAL     2   // Time (ms) between two samples of the potentiometers
+#define POT_ADC_PRESCALER       32  // ADC clock divider (16 - 128), 32 = 500 kHz, keeps oversampled conversions short
+// Sleep mode during pot conversions. SLEEP_MODE_ADC (noise reduction) would be even quieter,
+// but also halts the I/O clock, so millis(), the serial port and the BAM zones stall for
+// every conversion. Only use it without BAM_STRIPS and with few oversampled conversions.
+#define POT_ADC_SLEEP_MODE      SLEEP_MODE_IDLE
 // #define POTS_INVERTED // Inverts the potentiometer readings in case of wiring screw ups...
 
-// Lower bounds
+// Movement detection
+// A pot is considered moved once it deviates from its slowly drifting baseline by more than
+// POT_MOV_DET_SIGMAS standard deviations of its measured noise, limited to the range of
+// POT_MOV_DET_MAX_DEV to POT_MOV_DET_CEILING (both in 8-bit steps).
+#define POT_MOV_DET_SIGMAS      4   // [s] (max. 16)
+#define POT_MOV_DET_MAX_DEV     3   // [s] Min. threshold
+#define POT_MOV_DET_CEILING     24  // Max. threshold, so noisy pots remain responsive
+#define POT_BASELINE_SHIFT      12  // Each sample moves the baseline by 1/2^n of its deviation (12 = ~8 s at 2 ms)
+#define POT_NOISE_SHIFT         9   // Each sample moves the noise estimate by 1/2^n (9 = ~1 s at 2 ms)
+
+// Takeover
+// Once a patch or color is programmed, every channel keeps its programmed level until its own
+// pot is moved. With pickup enabled, a moved channel is only taken over once its pot crosses
+// the programmed level, so the light doesn't jump to the pot.
+#define POT_PICKUP              0   // [s] (0 = off, 1 = on)
+
+// Slew rate limiting
+// Maximum change of the potentiometer driven outputs per frame, as 8.8 fixed-point
+// value (0x0100 = one 8-bit step). At 0x0800 and 100 FPS, the full range takes 320 ms.
+#define R_SLEW_RATE 0x0800
+#define G_SLEW_RATE 0x0800
+#define B_SLEW_RATE 0x0800
+#define M_SLEW_RATE 0x0800
+#define SLEW_SMOOTHING 2 // Each frame moves 1/2^n of the remaining distance (0 = no smoothing)
+
+// Filter chains
+// Every potentiometer sample passes a filter chain of { median, iir_shift, deadband, oversampling }:
+// - median: Median of the last 1 (off), 3 or 5 samples, removes single spikes
+// - iir_shift: Low pass, each sample moves the output by 1/2^n of the remaining distance (0 = off)
+// - deadband: Noise in ADC counts (0 - 1023) that doesn't change the output (0 = off)
+// - oversampling: Every sample averages 4^n conversions, which adds n bits to the 10-bit ADC and
+//   to the 8-bit output (0 - 3). The extra bits are passed on to the light outputs, ex. 2 (16x)
+//   dims the main light in 1024 instead of 256 steps. Each conversion takes ~28 us (See POT_ADC_PRESCALER).
+// Noisy potentiometers need a stronger filter, at the cost of a less direct response.
+#define R_POT_FILTER { 3, 2, 2, 0 }
+#define G_POT_FILTER { 3, 2, 2, 0 }
+#define B_POT_FILTER { 3, 2, 2, 0 }
+#define M_POT_FILTER { 3, 2, 2, 2 }
+
+// Calibration
+// The end points of every pot are recorded by a calibration (See README) and stored in the
+// EEPROM, between the legacy patch slots and the journal. Readings within the guard of a
+// recorded end point already map to that end, so noise can't keep a pot from reaching it.
+// Pots whose recorded end points are less than the min. span apart haven't been turned to
+// both ends and keep their previous calibration.
+#define EEPROM_CALIBRATION_ADDR 0x32
+#define POT_CALIBRATION_GUARD   3    // ADC counts
+#define POT_CALIBRATION_MIN_SPAN 768 // ADC counts (3/4 of the scale)
+
+// Lower bounds [s]
 // When pot values are less and equal to the lower bound, 
 // the color channel is disabled. This serves to compensate
 // for flickering caused by potentiometer noise.
@@ -87,14 +171,59 @@
 #define B_POT_LOWER_BOUND 0
 #define M_POT_LOWER_BOUND 0
 
+/* Brightness curves */
+// Curves applied to the outputs by default (linear_curve, gamma_curve or cie_curve).
+// Perceptual curves spread the knob travel evenly over the perceived brightness.
+#define R_CURVE cie_curve
+#define G_CURVE cie_curve
+#define B_CURVE cie_curve
+#define M_CURVE cie_curve
+#define GAMMA   2.2 // Exponent of gamma_curve
+
 /* 7-Segment Patch Indicator */
-#define NUM_SAVE_BLINKS    3
-#define BLINK_INTERVAL_ON  250  // ms
-#define BLINK_INTERVAL_OFF 250  // ms
-#define PATCH_DISPLAY_TIME 5000 // Time (ms) for 7-seg to remain on after changing patches
+#define NUM_SAVE_BLINKS    3    // [s]
+#define BLINK_INTERVAL_ON  250  // [s] ms
+#define BLINK_INTERVAL_OFF 250  // [s] ms
+#define PATCH_DISPLAY_TIME 5000 // [s] Time (ms) for 7-seg to remain on after changing patches
 
 /* Patches */
-#define EEPROM_PATCH_ADDR  0x0 // Start of patches array in EEPROM
+#define NUM_BANKS 2 // Banks of 10 patches (max. 2). Every patch permanently occupies up to 16 of the ~700 journal bytes,
+                    // and another bank's worth is kept free for imports. Only the rest spreads the wear.
+#define EEPROM_JOURNAL_ADDR 0x40 // Start of the wear leveled patch journal in EEPROM
+#define EEPROM_JOURNAL_SIZE (EEPROM_GESTURE_ADDR - EEPROM_JOURNAL_ADDR)
+#define EEPROM_LEGACY_JOURNAL_SIZE (E2END + 1 - EEPROM_JOURNAL_ADDR) // Journals of older firmware spanned the rest of the EEPROM
+
+// Legacy fixed patch slots, migrated into the journal on first boot
+#define EEPROM_PATCH_ADDR  0x0  // Start of patches array in EEPROM
+#define EEPROM_FADE_ADDR   0x28 // Start of patch fade times array in EEPROM (after the 10 patches)
+
+// Factory default patches {R, G, B, M}, used for patches that have
+// never been saved or whose EEPROM records are corrupted
+#define FACTORY_PATCHES { \
+        {   0,   0,   0, 255 }, /* 0: Main light */ \
+        { 255, 120,  20, 128 }, /* 1: Dimmed main light, warm RGB */ \
+        { 255, 120,  20,   0 }, /* 2: Warm RGB only */ \
+        { 255,   0,   0,   0 }, /* 3: Red */ \
+        {   0, 255,   0,   0 }, /* 4: Green */ \
+        {   0,   0, 255,   0 }, /* 5: Blue */ \
+        { 180,   0, 255,   0 }, /* 6: Purple */ \
+        {   0, 200, 255,   0 }, /* 7: Cyan */ \
+        { 255, 255, 255,   0 }, /* 8: White RGB */ \
+        {   0,   0,   0,   0 }  /* 9: Off */ \
+}
+
+#define FADE_TIME_UNIT     100  // ms, Resolution of patch fade times
+#define PATCH_DEFAULT_FADE 10   // Fade time (in FADE_TIME_UNIT) of patches without a configured fade time
+
+/* Live state */
+#define STATE_SAVE_DELAY     10000 // Time (ms) the output must remain unchanged before it is saved
+#define STATE_SAVE_TOLERANCE 2     // Max deviation of a channel that isn't considered a change
+
+/* Gesture recorder */
+#define EEPROM_GESTURE_SIZE     256  // Bytes reserved at the end of the EEPROM for the recorded gesture
+#define EEPROM_GESTURE_ADDR     (E2END + 1 - EEPROM_GESTURE_SIZE)
+#define GESTURE_SAMPLE_INTERVAL 10   // Frames between two recorded samples (100 ms at 100 Hz)
+#define GESTURE_DEADBAND        2    // Max deviation of a potentiometer that isn't recorded as movement
 
 /* Boot message */
 #define BOOT_MSG_AUTHORS "Patrick Pedersen <ctx.xda@gmail.com>"
@@ -38,6 +38,7 @@
 void flash(RGBStrip *rgbstrp, RgbColor color, unsigned long duration)
 {
         rgbstrp->set(color);
+        rgbstrp->commit();
         delay(duration);
 }
 
@@ -20,9 +20,12 @@
    */
 
 #include <math.h>
+#include <stddef.h>
+#include <util/crc16.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
 
 #include <Arduino.h>
-#include <EEPROM.h>
 #include <NeoPixelBus.h> // https://github.com/Makuna/NeoPixelBus
 
 #include "config.h"
@@ -30,6 +33,15 @@
 #include "credits.h"
 #include "PatchIndicator.h"
 #include "PatchEncoder.h"
+#include "BAMDimmer.h"
+#include "Crossfade.h"
+#include "SlewLimiter.h"
+#include "Journal.h"
+#include "AsyncEEPROM.h"
+#include "Gesture.h"
+#include "Timers.h"
+#include "PotFilter.h"
+#include "MovementDetector.h"
 
 #ifndef __AVR__
 #error Sorry, only AVR boards are currently supported
@@ -39,6 +51,25 @@
 
 #define RGB_HEX_STR_LEN  7 // #AABBCC
 #define RGBM_HEX_STR_LEN 9 // #AABBCCDD
+#define ZONE_CMD_STR_LEN 4 // zNAA
+#define CURVE_CMD_STR_LEN 3 // cCN
+#define FADE_CMD_STR_MAX  4 // fNNN
+#define BANK_CMD_STR_LEN  (1 + 2 * BANK_BLOCK_SIZE) // pNN, 10 patches {RRGGBBMMFF}, CRC
+#define EXPORT_CMD        "x"
+#define IMPORT_CMD        "pcommit"
+#define PLAY_CMD          "r"
+#define DEFAULTS_CMD      "sdefaults"
+#define CALIBRATE_CMD     "k"
+#define UNCALIBRATE_CMD   "kclear"
+
+#define NO_FADE_TIME 0xFF // Erased EEPROM, patch has no configured fade time
+
+#define NUM_PATCHES (NUM_BANKS * 10) // Patches of all banks
+#define STATE_JOURNAL_KEY (JOURNAL_MAX_KEYS - 1) // Journal key of the live state (after all patches)
+#define LEGACY_STATE_JOURNAL_KEY 10 // Journal key of the live state in layout 2 journals written before banks existed
+#define SETTINGS_JOURNAL_KEY (JOURNAL_MAX_KEYS - 2) // Journal key of the firmware settings
+
+#define FRAME_INTERVAL (1000 / FRAME_RATE) // ms
 
 //////////////////////////////
 // Structs
@@ -57,6 +88,125 @@ struct rgbm {
         uint8_t M;
 };
 
+/* patch_record
+ * ------------
+ * Description:
+ *      Fixed size journal payload of a patch, as stored by journal layouts 1 and 2
+ */
+
+struct patch_record {
+        rgbm color;
+        uint8_t fade;
+};
+
+static_assert(sizeof(patch_record) == JOURNAL_SLOT_DATA, "Patch records must match the payload size of older journals");
+
+/* patch_field
+ * -----------
+ * Description:
+ *      Type tags of the fields of a patch record. Every field starts with a tag byte,
+ *      holding the type in the upper and the field size in the lower nibble.
+ *      Fields of unknown types are skipped, so new fields (ex. zones or effect
+ *      parameters) can be added without breaking existing records.
+ *      Omitted fields keep their defaults (factory color, default fade time).
+ *      - field_color: Absolute {R, G, B, M}
+ *      - field_color_diff: Mask of the channels that differ from the factory default,
+ *        followed by the values of these channels
+ *      - field_fade: Fade time in FADE_TIME_UNIT
+ */
+
+enum patch_field {
+        field_color,
+        field_color_diff,
+        field_fade
+};
+
+#define FIELD_TAG(type, size) (((type) << 4) | (size))
+
+#define BANK_BLOCK_SIZE (1 + 10 * sizeof(patch_record) + 1) // Bank number, patches and CRC-8 of a bank transfer
+#define PATCH_DATA_MAX (1 + sizeof(rgbm) + 1 + 1) // Largest patch record (absolute color and fade time)
+
+/* state_record
+ * ------------
+ * Description:
+ *      Journal payload of the live state, restored on boot
+ */
+
+struct state_record {
+        rgbm color;
+        uint8_t patch;
+};
+
+static_assert(sizeof(state_record) == JOURNAL_SLOT_DATA, "State records must remain readable from older journals");
+
+/* settings_record
+ * ---------------
+ * Description:
+ *      Journal payload of the firmware parameters that can be tuned at runtime
+ *      (See settings_table). New fields must only be appended, as fields
+ *      missing from records of older firmware keep their defaults.
+ */
+
+struct settings_record {
+        uint8_t pot_mov_sigmas;         // Movement threshold in standard deviations of the potentiometer noise
+        uint8_t pot_max_dev;            // Min. deviation of a potentiometer that is considered movement
+        uint8_t pot_lower_bound[4];     // Lower bounds of the R, G, B and M potentiometers
+        uint16_t debounce_time;         // Rotary encoder push button debounce time (ms)
+        uint16_t blink_on;              // Patch indicator blink on time (ms)
+        uint16_t blink_off;             // Patch indicator blink off time (ms)
+        uint16_t display_time;          // Time (ms) the patch indicator remains on after changing patches
+        uint8_t save_blinks;            // Number of blinks confirming a save
+        uint8_t pot_pickup;             // Programmed channels are only taken over once their potentiometer crosses their level
+};
+
+static_assert(sizeof(settings_record) <= JOURNAL_MAX_DATA, "Settings exceed the payload size of a journal record");
+
+/* setting
+ * -------
+ * Description:
+ *      Entry of the settings table, describing a field of the settings record
+ *      which can be changed via serial, along with its valid range.
+ */
+
+struct setting {
+        char name[12];
+        uint8_t offset;                 // Offset of the field in settings_record
+        uint8_t size;                   // Size of the field (1 or 2 bytes)
+        uint16_t min;
+        uint16_t max;
+};
+
+#define SETTING(name, field, min, max) { name, offsetof(settings_record, field), sizeof(((settings_record *) 0)->field), min, max }
+
+/* calibration_record
+ * ------------------
+ * Description:
+ *      End points of the R, G, B and M potentiometers as stored in EEPROM.
+ *      The margins are given in ADC counts and limited to 254, 255 marks
+ *      an end that hasn't been sampled during a calibration.
+ */
+
+struct calibration_record {
+        uint8_t low[4];                 // Reading at the lower end of every potentiometer
+        uint8_t high[4];                // Margin of the reading at the upper end of every potentiometer to 1023
+        uint8_t crc;                    // CRC-8 (CCITT polynomial, initial value 0xFF) of the above
+};
+
+static_assert(EEPROM_CALIBRATION_ADDR >= EEPROM_FADE_ADDR + 10 &&
+              EEPROM_CALIBRATION_ADDR + sizeof(calibration_record) <= EEPROM_JOURNAL_ADDR,
+              "The potentiometer calibration must fit between the legacy patch slots and the journal");
+
+// Every patch occupies a journal key. Besides the latest records of all keys at their largest, the journal
+// must hold a bank of superseded patches along with the marker of the transaction that imports the bank
+// (See import_banks()). The remaining blocks spread the wear and keep fragmentation from failing writes.
+#define JOURNAL_LIVE_BLOCKS (NUM_PATCHES * JOURNAL_RECORD_BLOCKS(PATCH_DATA_MAX) + \
+                             JOURNAL_RECORD_BLOCKS(sizeof(state_record)) + 2 * JOURNAL_RECORD_BLOCKS(sizeof(settings_record)))
+#define JOURNAL_TXN_BLOCKS  (10 * JOURNAL_RECORD_BLOCKS(PATCH_DATA_MAX) + JOURNAL_RECORD_BLOCKS(0))
+
+static_assert(NUM_PATCHES <= JOURNAL_TXN_KEY && NUM_BANKS <= 8, "NUM_BANKS exceeds the number of journal keys");
+static_assert(JOURNAL_LIVE_BLOCKS + JOURNAL_TXN_BLOCKS < JOURNAL_BLOCKS(EEPROM_JOURNAL_SIZE),
+              "NUM_BANKS leaves the journal no headroom for wear leveling and imports");
+
 //////////////////////////////
 // Functions
 //////////////////////////////
@@ -82,50 +232,88 @@ inline uint32_t uint32_pow(uint8_t base, uint8_t pow)
         return ret;
 }
 
-/* adc_to_rgb
- * ----------
+volatile bool adc_done; // Set by the ADC conversion complete interrupt
+
+// Wakes the CPU from the sleep in adc_read()
+ISR(ADC_vect)
+{
+        adc_done = true;
+}
+
+/* adc_read
+ * --------
  * Arguments:
- *      val - A 16 bit analogRead() return
+ *      pin - Analog pin to be converted
  * Returns:
- *      val >> 2 (= val/4)
+ *      The 10-bit conversion of the pin
  * Description:
- *      Reduces analogRead() values to a byte (0-255)
+ *      Replaces analogRead(), but sleeps through the conversion instead of
+ *      busy-waiting, which keeps the digital noise of the CPU out of the reading.
+ *      The conversion runs in POT_ADC_SLEEP_MODE. If any other interrupt wakes the
+ *      CPU before the conversion completes, the rest is slept through in idle mode.
  */
 
-inline uint8_t adc_to_rgb(uint16_t val)
+uint16_t adc_read(uint8_t pin)
 {
-        if (val == 0)
-                return 0;
-        else if (val < 4)
-                return 1;
+        if (pin >= A0)
+                pin -= A0;
 
-        return (val >> 2);
+        ADMUX = _BV(REFS0) | (pin & 0x07); // AVcc reference, as analogRead()
+        ADCSRA |= _BV(ADIE);
+        adc_done = false;
+
+        // ADC noise reduction mode starts the conversion by itself
+        if (POT_ADC_SLEEP_MODE != SLEEP_MODE_ADC)
+                ADCSRA |= _BV(ADSC);
+
+        set_sleep_mode(POT_ADC_SLEEP_MODE);
+        sleep_enable();
+
+        for (;;) {
+                cli();
+
+                if (adc_done)
+                        break;
+
+                // sei() only takes effect after the next instruction, so the
+                // interrupt can't slip in between the check and sleeping
+                sei();
+                sleep_cpu();
+                set_sleep_mode(SLEEP_MODE_IDLE);
+        }
+
+        sei();
+        sleep_disable();
+        ADCSRA &= ~_BV(ADIE);
+
+        return ADC;
 }
 
-/* avg_pot_read
- * ----------
+/* pot_read
+ * --------
  * Arguments:
  *      pin - Pin of Potentiometer
- *      samples - Number of read samples to be averaged
+ *      oversampling - Extra bits of resolution to be gained by oversampling (0 - 3)
  * Returns:
- *      8-bit average
+ *      The 10 + oversampling bit reading, left aligned to 16 bits
  * Description:
- *      Reads an 8-bit average value of n potentiometer read samples.
+ *      Sums 4^oversampling conversions of the potentiometer and decimates the sum
+ *      to 10 + oversampling bits, which requires the ADC noise to span at least
+ *      one count (usually the case with potentiometers).
  */
 
-inline uint8_t avg_pot_read(uint8_t pin, uint16_t samples)
+inline uint16_t pot_read(uint8_t pin, uint8_t oversampling)
 {
-        uint64_t avg = 0;
-
-        for (uint16_t i = 0; i < samples; i++)
+        uint16_t sum = 0;
 
+        for (uint8_t i = 0; i < (1 << (2 * oversampling)); i++)
 #ifdef POTS_INVERTED
-                avg += ANALOG_READ_MAX - analogRead(pin);
+                sum += ANALOG_READ_MAX - adc_read(pin);
 #else
-                avg += analogRead(pin);
+                sum += adc_read(pin);
 #endif
 
-        return adc_to_rgb(round(avg/samples));
+        return (sum >> oversampling) << (6 - oversampling);
 }
 
 /* rgbm_pots_read
@@ -135,273 +323,1834 @@ inline uint8_t avg_pot_read(uint8_t pin, uint16_t samples)
  *      pot_g - Pin of green potentiometer
  *      pot_b - Pin of blue potentiometer
  *      pot_m - Pin of main lights potentiometer
+ *      filters - Filter chains of the R, G, B and M potentiometers
  * Returns:
  *      rgbm object of potentiometer values
  * Description:
- *      Returns the current red, green, blue and mains light potentiometer values to an rgbm object
+ *      Samples the red, green, blue and mains light potentiometers, feeds the samples
+ *      through their filter chains and returns the filtered values as rgbm object.
+ *      The full resolution of the filtered values can be read via pot_levels().
  */
 
-inline rgbm rgbm_pots_read(uint8_t pot_r, uint8_t pot_g, uint8_t pot_b, uint8_t pot_m)
+inline rgbm rgbm_pots_read(uint8_t pot_r, uint8_t pot_g, uint8_t pot_b, uint8_t pot_m, PotFilter *filters)
 {
         rgbm ret;
 
-#ifdef POTS_INVERTED
-        ret.rgb.R = adc_to_rgb(ANALOG_READ_MAX - analogRead(R_POT));
-        ret.rgb.G = adc_to_rgb(ANALOG_READ_MAX - analogRead(G_POT));
-        ret.rgb.B = adc_to_rgb(ANALOG_READ_MAX - analogRead(B_POT));
-        ret.M = adc_to_rgb(ANALOG_READ_MAX - analogRead(M_POT));
+        ret.rgb.R = filters[0].update(pot_read(pot_r, filters[0].oversampling()));
+        ret.rgb.G = filters[1].update(pot_read(pot_g, filters[1].oversampling()));
+        ret.rgb.B = filters[2].update(pot_read(pot_b, filters[2].oversampling()));
+        ret.M = filters[3].update(pot_read(pot_m, filters[3].oversampling()));
+
+        return ret;
+}
+
+/* rgbm_pot_mov_det
+ * ----------
+ * Arguments:
+ *      filters - Filter chains of the R, G, B and M potentiometers
+ *      detector - Movement detector fed with the low passed potentiometer levels
+ * Returns:
+ *      A bit mask of the potentiometers that have been moved (bit 0 = R, ..., bit 3 = M),
+ *      or 0 if no significant potentiometer movement has been detected
+ * Description:
+ *      Detects between noise and real potentiometer movement.
+ *      Must be called once per potentiometer sample, as the detector
+ *      continuously learns the noise and drift of every potentiometer.
+ */
+
+inline uint8_t rgbm_pot_mov_det(PotFilter *filters, MovementDetector *detector)
+{
+        uint16_t levels[MOVEMENT_CHANNELS];
+
+        for (uint8_t i = 0; i < MOVEMENT_CHANNELS; i++)
+                levels[i] = filters[i].level();
+
+#ifdef NO_MAIN_STRIP
+        return detector->update(levels) & 0x07;
+#else
+        return detector->update(levels);
+#endif
+}
+
+//////////////////////////////
+// Global vars & Objects
+//////////////////////////////
+
+// LED Strips
+LEDStrip mainstrp(MAIN_STRIP);
+
+#if RGB_STRIP_TYPE == ADDRESSABLE
+RGBStrip rgbstrp(RGB_STRIP_LEDS, RGB_STRIP);
 #else
-        ret.rgb.R = adc_to_rgb(analogRead(R_POT));
-        ret.rgb.G = adc_to_rgb(analogRead(G_POT));
-        ret.rgb.B = adc_to_rgb(analogRead(B_POT));
-        ret.M = adc_to_rgb(analogRead(M_POT));
+RGBStrip rgbstrp(RGB_STRIP_R, RGB_STRIP_G, RGB_STRIP_B);
 #endif
 
-#if R_POT_LOWER_BOUND > 0
-        if (ret.rgb.R <= R_POT_LOWER_BOUND)
-                ret.rgb.R = 0;
+#ifdef BAM_STRIPS
+const uint8_t bam_pins[] = { BAM_STRIPS };
+BAMDimmer bamstrps(bam_pins, sizeof(bam_pins)); // Additional main light zones
 #endif
 
-#if G_POT_LOWER_BOUND > 0
-        if (ret.rgb.G <= G_POT_LOWER_BOUND)
-                ret.rgb.G = 0;
+timer_id frame_timer = timers.add(); // Paces the light outputs at FRAME_RATE
+
+// Potentiometer filter chains (R, G, B, M), fed every POT_SAMPLE_INTERVAL
+PotFilter pot_filters[4] = {
+        PotFilter(R_POT_FILTER),
+        PotFilter(G_POT_FILTER),
+        PotFilter(B_POT_FILTER),
+        PotFilter(M_POT_FILTER)
+};
+
+timer_id pot_timer = timers.add(); // Paces the potentiometer sampling
+
+// Tells potentiometer movement apart from noise and drift
+MovementDetector movement(POT_BASELINE_SHIFT, POT_NOISE_SHIFT, POT_MOV_DET_SIGMAS, POT_MOV_DET_MAX_DEV, POT_MOV_DET_CEILING);
+
+rgbm rgbmpots; // Stores current potentiometer values
+
+rgbm patches[10]; // Patches/Slots of RGBM configurations of the active bank
+uint8_t fades[10]; // Fade times of all patches of the active bank (in FADE_TIME_UNIT)
+const uint8_t factory_patches[10][sizeof(rgbm)] PROGMEM = FACTORY_PATCHES; // Defaults of unsaved or corrupted patches
+uint8_t current_patch; // Currently selected patch within the active bank
+uint8_t current_bank; // Active bank, loaded into patches[] and fades[]
+patch_record *staged_banks = NULL; // Patches of all banks of an import in progress, NULL if none
+uint8_t staged_mask; // Banks staged for import (bit n = bank n)
+
+Journal journal(EEPROM_JOURNAL_ADDR, EEPROM_JOURNAL_SIZE, EEPROM_LEGACY_JOURNAL_SIZE); // Wear leveled patch storage
+
+state_record saved_state; // Live state last written to the journal
+state_record pending_state; // Live state at the last significant change
+timer_id state_timer = timers.add(); // Expires once the live state has settled
+
+#ifdef IDLE_SLEEP
+timer_id idle_timer = timers.add(); // Averages the idle time over IDLE_REPORT_INTERVAL
+unsigned long idle_us; // Time slept since the idle timer last expired
+uint8_t idle_percent; // Share of the last IDLE_REPORT_INTERVAL spent asleep
 #endif
 
-#if B_POT_LOWER_BOUND > 0
-        if (ret.rgb.B <= B_POT_LOWER_BOUND)
-                ret.rgb.B = 0;
+// Firmware parameters tunable via serial, stored in the journal
+const settings_record default_settings PROGMEM = {
+        POT_MOV_DET_SIGMAS,
+        POT_MOV_DET_MAX_DEV,
+        { R_POT_LOWER_BOUND, G_POT_LOWER_BOUND, B_POT_LOWER_BOUND, M_POT_LOWER_BOUND },
+        ROTARY_ENC_DEBOUCE_TIME,
+        BLINK_INTERVAL_ON,
+        BLINK_INTERVAL_OFF,
+        PATCH_DISPLAY_TIME,
+        NUM_SAVE_BLINKS,
+        POT_PICKUP
+};
+
+const setting settings_table[] PROGMEM = {
+        SETTING("sigmas",      pot_mov_sigmas,     1, 16),
+        SETTING("max_dev",     pot_max_dev,        1, 127),
+        SETTING("r_lower",     pot_lower_bound[0], 0, 127),
+        SETTING("g_lower",     pot_lower_bound[1], 0, 127),
+        SETTING("b_lower",     pot_lower_bound[2], 0, 127),
+        SETTING("m_lower",     pot_lower_bound[3], 0, 127),
+        SETTING("debounce",    debounce_time,      0, 1000),
+        SETTING("blink_on",    blink_on,           10, 2000),
+        SETTING("blink_off",   blink_off,          10, 2000),
+        SETTING("display",     display_time,       0, 60000),
+        SETTING("save_blinks", save_blinks,        0, 10),
+        SETTING("pickup",      pot_pickup,         0, 1)
+};
+
+#define NUM_SETTINGS (sizeof(settings_table) / sizeof(setting))
+
+settings_record settings; // Settings in use, loaded on boot
+
+calibration_record calibration; // End points of the potentiometers in use, loaded on boot
+calibration_record cal_progress; // End points reached during the running calibration
+bool calibrating = false;
+
+// Rotary Encoder
+PatchEncoder patch_encoder(ROTARY_ENC_DT, ROTARY_ENC_CLK, ROTARY_ENC_SW,
+                           ROTARY_ENC_TRANSITIONS, ROTARY_ENC_ACCEL_TIME, ROTARY_ENC_ACCEL_MAX,
+                           ROTARY_ENC_DEBOUCE_TIME, LONG_PRESS_TIME, DOUBLE_CLICK_TIME);
+
+// 7 Segment patch indicator
+PatchIndicator patch_indicator (
+        SEV_SEG_COMMON_MODE, 
+        SEV_SEG_COMMON,
+        SEV_SEG_A, 
+        SEV_SEG_B, 
+        SEV_SEG_C, 
+        SEV_SEG_D, 
+        SEV_SEG_E, 
+        SEV_SEG_F, 
+        SEV_SEG_G,
+        SEV_SEG_DP
+);
+
+// Crossfade between patches
+Crossfade crossfade;
+
+// Recorded potentiometer movement, played back in a loop
+Gesture gesture(EEPROM_GESTURE_ADDR, EEPROM_GESTURE_SIZE, GESTURE_SAMPLE_INTERVAL, GESTURE_DEADBAND);
+
+// Slew rate limiter for potentiometer driven output
+const uint16_t slew_rates[num_channels] = { R_SLEW_RATE, G_SLEW_RATE, B_SLEW_RATE, M_SLEW_RATE };
+SlewLimiter slew(slew_rates, SLEW_SMOOTHING);
+
+// External color programming
+
+const uint8_t all_channels = (1 << num_channels) - 1;
+
+// Channels (bit 0 = R, ..., bit 3 = M) that maintain their programmed
+// level until movement of their potentiometer is detected
+uint8_t programmed = 0;
+
+uint8_t pickup_armed = 0; // Programmed channels whose potentiometer has been moved, waiting to cross their level
+uint8_t pickup_above = 0; // Armed channels whose potentiometer has been above their level
+
+// Boot message, streamed to the serial console from the main loop (See banner_tx())
+const char banner[] PROGMEM = BOOT_MSG_ASCII_ART "\n\r\n"
+                              "Author(s): " BOOT_MSG_AUTHORS "\r\n"
+                              "License: " BOOT_MSG_LICENSE "\r\n"
+                              "Build date: " __DATE__ "\r\n"
+                              "Documentation: " BOOT_MSG_SRC "\r\n";
+const char *banner_pos = banner; // Next character of the boot message to be sent, NULL once sent
+
+unsigned long boot_light_us; // micros() at which the restored outputs were first shown
+unsigned long boot_ready_us; // micros() at which the dimmer started responding to input
+timer_id boot_timer = timers.add(); // Expires once the encoder push button has been debounced after boot
+
+//////////////////////////////
+// Frame scheduling
+//////////////////////////////
+
+/* frame_due
+ * ---------
+ * Returns:
+ *      True - A new frame must be committed to the light outputs
+ *      False - The current frame interval hasn't elapsed yet
+ * Description:
+ *      Paces the light outputs at FRAME_RATE. Should the main loop
+ *      fall behind by more than a frame, the missed frames are dropped.
+ */
+
+inline bool frame_due()
+{
+        return timers.expired(frame_timer);
+}
+
+#ifdef IDLE_SLEEP
+
+//////////////////////////////
+// Idle
+//////////////////////////////
+
+/* idle
+ * ----
+ * Description:
+ *      Sleeps the CPU in idle mode if no timer is due, until the next interrupt.
+ *      Timer0 (millis()), the encoder, the serial port and the BAM driver all
+ *      keep running and wake the CPU, so at most ~1 ms passes before the main
+ *      loop runs again. The time slept is averaged into idle_percent.
+ */
+
+void idle()
+{
+        if (timers.expired(idle_timer)) {
+                idle_percent = idle_us / (IDLE_REPORT_INTERVAL * 10UL);
+                idle_us = 0;
+        }
+
+        if (timers.next_due() == 0)
+                return;
+
+        unsigned long start = micros();
+
+        set_sleep_mode(SLEEP_MODE_IDLE);
+        sleep_enable();
+        sleep_cpu();
+        sleep_disable();
+
+        idle_us += micros() - start;
+}
+
 #endif
 
-#if M_POT_LOWER_BOUND > 0
-        if (ret.M <= M_POT_LOWER_BOUND)
-                ret.M = 0;
+//////////////////////////////
+// Light output
+//////////////////////////////
+
+/* get_levels
+ * ----------
+ * Arguments:
+ *      levels - Return array for the 8.8 fixed-point levels of all light channels
+ * Description:
+ *      Reads the levels currently set on the RGB strip and main light
+ */
+
+void get_levels(uint16_t *levels)
+{
+        levels[channel_r] = rgbstrp.get_fine(channel_r);
+        levels[channel_g] = rgbstrp.get_fine(channel_g);
+        levels[channel_b] = rgbstrp.get_fine(channel_b);
+        levels[channel_m] = mainstrp.get_fine();
+}
+
+/* set_levels
+ * ----------
+ * Arguments:
+ *      levels - 8.8 fixed-point levels of all light channels
+ * Description:
+ *      Sets the RGB strip and main light to the provided levels.
+ *      Outputs whose levels remain unchanged aren't touched.
+ */
+
+void set_levels(const uint16_t *levels)
+{
+        uint16_t current[num_channels];
+
+        get_levels(current);
+
+        // Only touch the outputs whose levels have changed
+        if (levels[channel_r] != current[channel_r] ||
+            levels[channel_g] != current[channel_g] ||
+            levels[channel_b] != current[channel_b])
+                rgbstrp.set_fine(levels[channel_r], levels[channel_g], levels[channel_b]);
+#ifndef NO_MAIN_STRIP
+        if (levels[channel_m] != current[channel_m])
+                mainstrp.set_fine(levels[channel_m]);
 #endif
+}
 
-        return ret;
+/* rgbm_to_levels
+ * --------------
+ * Arguments:
+ *      rgbm - rgbm object to be converted
+ *      levels - Return array for the 8.8 fixed-point levels of all light channels
+ */
+
+void rgbm_to_levels(rgbm rgbm, uint16_t *levels)
+{
+        levels[channel_r] = byte_to_level(rgbm.rgb.R);
+        levels[channel_g] = byte_to_level(rgbm.rgb.G);
+        levels[channel_b] = byte_to_level(rgbm.rgb.B);
+        levels[channel_m] = byte_to_level(rgbm.M);
 }
 
-/* avg_rgbm_pot_read
+/* pot_levels
  * ----------
  * Arguments:
- *      pot_r - Pin of red potentiometer
- *      pot_g - Pin of green potentiometer
- *      pot_b - Pin of blue potentiometer
- *      pot_m - Pin of main lights potentiometer
- *      samples - Potentiometer read samples to be averaged
+ *      levels - Return array for the 8.8 fixed-point levels of all potentiometers
+ * Description:
+ *      Reads the filtered potentiometer values at their full resolution, so
+ *      oversampled potentiometers drive their outputs with more than 8 bits
+ */
+
+void pot_levels(uint16_t *levels)
+{
+        levels[channel_r] = pot_filters[0].fine();
+        levels[channel_g] = pot_filters[1].fine();
+        levels[channel_b] = pot_filters[2].fine();
+        levels[channel_m] = pot_filters[3].fine();
+}
+
+/* program_all
+ * -----------
+ * Description:
+ *      Makes all channels maintain their programmed level (ex. a loaded patch)
+ *      until their potentiometer is moved.
+ */
+
+void program_all()
+{
+        programmed = all_channels;
+        pickup_armed = 0;
+}
+
+/* take_over
+ * ---------
+ * Arguments:
+ *      channels - Bit mask of the channels to be handed over (bit 0 = R, ..., bit 3 = M)
+ * Description:
+ *      Hands the provided channels over to their potentiometers. The slew
+ *      limiter carries them from their current levels over to the potentiometers,
+ *      while the remaining programmed channels keep their levels. Gestures are
+ *      stopped, and crossfades continue on the programmed channels only.
+ */
+
+void take_over(uint8_t channels)
+{
+        uint16_t levels[num_channels];
+
+        channels &= programmed;
+
+        if (!channels)
+                return;
+
+        get_levels(levels);
+        slew.reset(levels);
+
+        gesture.stop();
+        programmed &= ~channels;
+        pickup_armed &= ~channels;
+
+        if (!programmed)
+                crossfade.stop();
+}
+
+/* pickup
+ * ------
+ * Arguments:
+ *      moved - Bit mask of the potentiometers that have been moved (See rgbm_pot_mov_det)
  * Returns:
- *      rgbm object of average potentiometer values
+ *      Bit mask of the programmed channels to be handed over to their potentiometers
  * Description:
- *      Returns the current red, green, blue and mains light potentiometer values to an rgbm object
+ *      Without pickup, programmed channels are handed over as soon as their
+ *      potentiometer is moved. With pickup (See settings), a moved channel is armed
+ *      instead and only handed over once its potentiometer crosses the level of the
+ *      channel, so the light doesn't jump to the potentiometer. Must be called for
+ *      every potentiometer sample.
  */
 
-inline rgbm avg_rgbm_pot_read(uint8_t pot_r, uint8_t pot_g, uint8_t pot_b, uint8_t pot_m, uint16_t samples)
+uint8_t pickup(uint8_t moved)
 {
-        rgbm ret;
+        uint16_t pots[num_channels];
+        uint16_t levels[num_channels];
+        uint8_t ret = 0;
+
+        moved &= programmed;
+
+        if (!settings.pot_pickup)
+                return moved;
+
+        pot_levels(pots);
+        get_levels(levels);
+
+        for (uint8_t c = 0; c < num_channels; c++) {
+                uint8_t bit = 1 << c;
+                uint8_t above = (pots[c] >= levels[c]) ? bit : 0;
+
+                if (pickup_armed & bit) {
+                        if ((pickup_above & bit) != above)
+                                ret |= bit;
+                } else if (moved & bit) {
+                        pickup_armed |= bit;
+                        pickup_above = (pickup_above & ~bit) | above;
+                }
+        }
 
-        ret.rgb.R = avg_pot_read(pot_r, samples);
-        ret.rgb.G = avg_pot_read(pot_g, samples);
-        ret.rgb.B = avg_pot_read(pot_b, samples);
-        ret.M = avg_pot_read(pot_m, samples);
-        
         return ret;
 }
 
-/* rgbm_pot_mov_det
- * ----------
+/* patch_fade_time
+ * ---------------
+ * Arguments:
+ *      patch - Patch number
+ * Returns:
+ *      The fade time of the patch in ms
+ */
+
+unsigned long patch_fade_time(uint8_t patch)
+{
+        uint8_t fade = (fades[patch] == NO_FADE_TIME) ? PATCH_DEFAULT_FADE : fades[patch];
+        return (unsigned long) fade * FADE_TIME_UNIT;
+}
+
+/* fade_to_patch
+ * -------------
+ * Arguments:
+ *      patch - Patch number
+ * Description:
+ *      Starts a crossfade from the currently output levels to the levels of the
+ *      provided patch. Fades in progress are picked up from their current levels.
+ */
+
+void fade_to_patch(uint8_t patch)
+{
+        uint16_t from[num_channels];
+        uint16_t to[num_channels];
+
+        get_levels(from);
+        rgbm_to_levels(patches[patch], to);
+
+        crossfade.start(from, to, patch_fade_time(patch));
+}
+
+//////////////////////////////
+// Patch storage
+//////////////////////////////
+
+/* patch_key
+ * ---------
+ * Arguments:
+ *      bank - Bank number
+ *      patch - Patch number within the bank
+ * Returns:
+ *      The journal key of the patch
+ */
+
+inline uint8_t patch_key(uint8_t bank, uint8_t patch)
+{
+        return bank * 10 + patch;
+}
+
+/* encode_patch
+ * ------------
+ * Arguments:
+ *      patch - Patch number within its bank
+ *      color - Color of the patch
+ *      fade - Fade time of the patch (in FADE_TIME_UNIT)
+ *      buf - Return buffer for the record (PATCH_DATA_MAX bytes)
+ * Returns:
+ *      The size of the record in bytes
+ * Description:
+ *      Encodes a patch into type tagged fields (See patch_field).
+ *      Colors that only differ from the factory default in one or two
+ *      channels are stored as difference, and defaults aren't stored at all.
+ */
+
+uint8_t encode_patch(uint8_t patch, rgbm color, uint8_t fade, uint8_t *buf)
+{
+        uint8_t def[sizeof(rgbm)];
+        const uint8_t *cur = (const uint8_t *) &color;
+        uint8_t mask = 0;
+        uint8_t diffs = 0;
+        uint8_t len = 0;
+
+        memcpy_P(def, factory_patches[patch], sizeof(rgbm));
+
+        for (uint8_t i = 0; i < sizeof(rgbm); i++) {
+                if (cur[i] != def[i]) {
+                        mask |= 1 << i;
+                        diffs++;
+                }
+        }
+
+        if (diffs > 0 && diffs < sizeof(rgbm) - 1) {
+                buf[len++] = FIELD_TAG(field_color_diff, 1 + diffs);
+                buf[len++] = mask;
+
+                for (uint8_t i = 0; i < sizeof(rgbm); i++) {
+                        if (mask & (1 << i))
+                                buf[len++] = cur[i];
+                }
+        } else if (diffs > 0) {
+                buf[len++] = FIELD_TAG(field_color, sizeof(rgbm));
+                memcpy(&buf[len], cur, sizeof(rgbm));
+                len += sizeof(rgbm);
+        }
+
+        if (fade != NO_FADE_TIME) {
+                buf[len++] = FIELD_TAG(field_fade, 1);
+                buf[len++] = fade;
+        }
+
+        return len;
+}
+
+/* decode_patch
+ * ------------
+ * Arguments:
+ *      patch - Patch number within its bank
+ *      buf - Record of the patch
+ *      len - Size of the record in bytes
+ *      color - Return pointer for the color of the patch
+ *      fade - Return pointer for the fade time of the patch
+ * Description:
+ *      Decodes a patch record created by encode_patch()
+ */
+
+void decode_patch(uint8_t patch, const uint8_t *buf, uint8_t len, rgbm *color, uint8_t *fade)
+{
+        uint8_t *cur = (uint8_t *) color;
+
+        memcpy_P(color, factory_patches[patch], sizeof(rgbm));
+        *fade = NO_FADE_TIME;
+
+        for (uint8_t i = 0; i < len; i += 1 + (buf[i] & 0x0F)) {
+                uint8_t size = buf[i] & 0x0F;
+                const uint8_t *field = &buf[i + 1];
+
+                if (i + 1 + size > len)
+                        break;
+
+                switch (buf[i] >> 4) {
+                        case field_color:
+                                if (size == sizeof(rgbm))
+                                        memcpy(cur, field, sizeof(rgbm));
+                                break;
+                        case field_color_diff: {
+                                uint8_t n = 1;
+
+                                for (uint8_t c = 0; c < sizeof(rgbm) && size > 0; c++) {
+                                        if ((field[0] & (1 << c)) && n < size)
+                                                cur[c] = field[n++];
+                                }
+                                break;
+                        }
+                        case field_fade:
+                                if (size == 1)
+                                        *fade = field[0];
+                                break;
+                        default:
+                                break;
+                }
+        }
+}
+
+/* write_patch
+ * -----------
+ * Arguments:
+ *      key - Journal key of the patch
+ *      color - Color of the patch
+ *      fade - Fade time of the patch (in FADE_TIME_UNIT)
+ * Returns:
+ *      True, if the patch has been written to the journal
+ */
+
+bool write_patch(uint8_t key, rgbm color, uint8_t fade)
+{
+        uint8_t buf[PATCH_DATA_MAX];
+        uint8_t len = encode_patch(key % 10, color, fade, buf);
+
+        return journal.write(key, buf, len);
+}
+
+/* store_patch
+ * -----------
+ * Arguments:
+ *      patch - Patch number within the active bank
+ * Returns:
+ *      True, if the patch has been stored
+ * Description:
+ *      Appends the RAM copy of a patch to the journal
+ */
+
+bool store_patch(uint8_t patch)
+{
+        if (write_patch(patch_key(current_bank, patch), patches[patch], fades[patch]))
+                return true;
+
+        Serial.println("Patch storage is full!");
+        return false;
+}
+
+/* load_factory_patch
+ * ------------------
+ * Arguments:
+ *      patch - Patch number within the active bank
+ * Description:
+ *      Loads the factory default of a patch (provided in config.h) into RAM.
+ *      All banks share the same factory defaults.
+ */
+
+void load_factory_patch(uint8_t patch)
+{
+        memcpy_P(&patches[patch], factory_patches[patch], sizeof(rgbm));
+        fades[patch] = NO_FADE_TIME;
+}
+
+/* legacy_blank
+ * ------------
+ * Returns:
+ *      True, if the legacy fixed EEPROM slots are erased (ex. on a new chip)
+ */
+
+bool legacy_blank()
+{
+        for (uint16_t addr = EEPROM_PATCH_ADDR; addr < EEPROM_FADE_ADDR + 10; addr++) {
+                if (async_eeprom.read(addr) != 0xFF)
+                        return false;
+        }
+
+        return true;
+}
+
+/* backup_patches
+ * --------------
+ * Description:
+ *      Copies the 0th bank of a journal with an outdated layout back into the
+ *      legacy fixed EEPROM slots, decoding the type tagged records of layout 3.
+ *      Should the migration be interrupted, the journal header is gone, but the
+ *      0th bank is safe in the legacy slots, from where it is migrated on the
+ *      next boot.
+ */
+
+void backup_patches()
+{
+        for (uint8_t i = 0; i < 10; i++) {
+                patch_record rec;
+                uint8_t buf[JOURNAL_MAX_DATA];
+                uint8_t len;
+
+                if (!journal.read(i, buf, sizeof(buf), &len))
+                        len = 0;
+
+                // Patches the journal doesn't hold are backed up as factory defaults,
+                // which migrate_legacy_patches() doesn't store
+                if (journal.version() < 3 && len > 0)
+                        memcpy(&rec, buf, sizeof(rec));
+                else
+                        decode_patch(i, buf, len, &rec.color, &rec.fade);
+
+                async_eeprom.put(EEPROM_PATCH_ADDR + sizeof(rgbm) * i, rec.color);
+                async_eeprom.write(EEPROM_FADE_ADDR + i, rec.fade);
+        }
+}
+
+/* migrate_legacy_patches
+ * ----------------------
+ * Description:
+ *      Copies the patches and fade times from the legacy fixed EEPROM slots
+ *      into a freshly formatted journal. The journal header is only written
+ *      once all patches are copied and the legacy slots are left untouched,
+ *      so an interrupted migration is simply repeated on the next boot.
+ *      Erased legacy slots and slots holding factory defaults are not migrated,
+ *      leaving the factory defaults in place.
+ */
+
+void migrate_legacy_patches()
+{
+        bool blank = legacy_blank();
+
+        journal.format(false);
+
+        for (uint8_t i = 0; i < 10 && !blank; i++) {
+                patch_record rec;
+
+                uint8_t buf[PATCH_DATA_MAX];
+                uint8_t len;
+
+                async_eeprom.get(EEPROM_PATCH_ADDR + sizeof(rgbm) * i, rec.color);
+                rec.fade = async_eeprom.read(EEPROM_FADE_ADDR + i);
+                len = encode_patch(i, rec.color, rec.fade, buf);
+
+                // Factory defaults are restored without a record
+                if (len > 0)
+                        journal.write(i, buf, len);
+        }
+
+        journal.commit();
+}
+
+/* migrate_journal
+ * ---------------
+ * Description:
+ *      Migrates the patches, live state and settings of a journal with an outdated
+ *      layout into a journal of the current layout. The records are held in
+ *      RAM while the journal is reformatted, and the new header is only written
+ *      once all of them are stored. Should the migration be interrupted, the
+ *      journal is left unformatted and the next boot recovers the 0th bank from
+ *      the legacy fixed EEPROM slots, where it is backed up first. The other
+ *      banks, the live state and the settings are lost in that case. Fixed
+ *      size patch records of layouts 1 and 2 are re-encoded, while the type
+ *      tagged records of layout 3 are carried over as is. A live state stored
+ *      under its key from before banks existed is moved to the current key.
+ */
+
+void migrate_journal()
+{
+        uint8_t recs[NUM_PATCHES][PATCH_DATA_MAX];
+        uint8_t lens[NUM_PATCHES];
+        bool found[NUM_PATCHES];
+        bool fixed = journal.version() < 3;
+        state_record state;
+        bool has_state = journal.read(STATE_JOURNAL_KEY, &state, sizeof(state));
+        settings_record stored;
+        uint8_t stored_len;
+        bool has_settings = journal.read(SETTINGS_JOURNAL_KEY, &stored, sizeof(stored), &stored_len);
+
+        backup_patches();
+
+        for (uint8_t i = 0; i < NUM_PATCHES; i++)
+                found[i] = journal.read(i, recs[i], PATCH_DATA_MAX, &lens[i]);
+
+        // Before banks existed, the live state was stored under the key that now holds the
+        // 0th patch of the 1st bank. Such journals hold neither a state under the current
+        // key nor patches of other banks, which tells them apart from banked ones.
+        if (fixed && !has_state && journal.read(LEGACY_STATE_JOURNAL_KEY, &state, sizeof(state))) {
+                bool banked = false;
+
+                for (uint8_t i = LEGACY_STATE_JOURNAL_KEY + 1; i < NUM_PATCHES; i++)
+                        banked |= found[i];
+
+                has_state = !banked && state.patch < 10;
+
+                if (has_state && LEGACY_STATE_JOURNAL_KEY < NUM_PATCHES)
+                        found[LEGACY_STATE_JOURNAL_KEY] = false;
+        }
+
+        journal.format(false);
+
+        for (uint8_t i = 0; i < NUM_PATCHES; i++) {
+                if (!found[i])
+                        continue;
+
+                if (fixed) {
+                        patch_record rec;
+
+                        memcpy(&rec, recs[i], sizeof(rec));
+                        write_patch(i, rec.color, rec.fade);
+                } else {
+                        journal.write(i, recs[i], min(lens[i], PATCH_DATA_MAX));
+                }
+        }
+
+        if (has_state)
+                journal.write(STATE_JOURNAL_KEY, &state, sizeof(state));
+
+        if (has_settings)
+                journal.write(SETTINGS_JOURNAL_KEY, &stored, min(stored_len, sizeof(stored)));
+
+        journal.commit();
+}
+
+/* read_patch
+ * ----------
+ * Arguments:
+ *      key - Journal key of the patch
+ *      color - Return pointer for the color of the patch
+ *      fade - Return pointer for the fade time of the patch
+ * Description:
+ *      Reads a patch of any bank from the journal. Patches without
+ *      a valid record fall back to their factory defaults.
+ */
+
+void read_patch(uint8_t key, rgbm *color, uint8_t *fade)
+{
+        uint8_t buf[JOURNAL_MAX_DATA];
+        uint8_t len;
+
+        if (!journal.read(key, buf, sizeof(buf), &len))
+                len = 0;
+
+        decode_patch(key % 10, buf, len, color, fade);
+}
+
+/* load_bank
+ * ---------
+ * Arguments:
+ *      bank - Bank number
+ * Description:
+ *      Loads the patches of a bank from the journal into RAM and makes it the
+ *      active bank.
+ */
+
+void load_bank(uint8_t bank)
+{
+        current_bank = bank;
+
+        for (uint8_t i = 0; i < 10; i++)
+                read_patch(patch_key(bank, i), &patches[i], &fades[i]);
+}
+
+/* load_patches
+ * ------------
+ * Description:
+ *      Opens the journal, migrating older EEPROM layouts first,
+ *      and loads the 0th bank into RAM.
+ */
+
+void load_patches()
+{
+        switch (journal.begin()) {
+                case journal_outdated:
+                        migrate_journal();
+                        break;
+                case journal_unformatted:
+                        migrate_legacy_patches();
+                        break;
+                default:
+                        break;
+        }
+
+        // Patches of banks beyond NUM_BANKS (ex. after lowering it) would occupy the journal for good
+        for (uint8_t key = NUM_PATCHES; key < JOURNAL_TXN_KEY; key++)
+                journal.erase(key);
+
+        load_bank(0);
+}
+
+//////////////////////////////
+// Live state
+//////////////////////////////
+
+/* get_state
+ * ---------
+ * Returns:
+ *      The currently committed light output and selected patch
+ */
+
+state_record get_state()
+{
+        state_record state;
+
+        state.color.rgb = rgbstrp.get();
+        state.color.M = mainstrp.get();
+        state.patch = patch_key(current_bank, current_patch);
+
+        return state;
+}
+
+/* state_changed
+ * -------------
+ * Arguments:
+ *      a - First state
+ *      b - Second state
+ * Returns:
+ *      True - The states differ by more than STATE_SAVE_TOLERANCE or select different patches
+ *      False - The states are equal, apart from minor deviations (ex. potentiometer noise)
+ */
+
+bool state_changed(const state_record &a, const state_record &b)
+{
+        return (
+                a.patch != b.patch ||
+                abs(a.color.rgb.R - b.color.rgb.R) > STATE_SAVE_TOLERANCE ||
+                abs(a.color.rgb.G - b.color.rgb.G) > STATE_SAVE_TOLERANCE ||
+                abs(a.color.rgb.B - b.color.rgb.B) > STATE_SAVE_TOLERANCE ||
+                abs(a.color.M - b.color.M) > STATE_SAVE_TOLERANCE
+        );
+}
+
+/* restore_state
+ * -------------
+ * Returns:
+ *      True - The live state has been restored from the journal
+ *      False - No live state has been saved yet
+ * Description:
+ *      Restores the light output and selected patch of the last session
+ */
+
+bool restore_state()
+{
+        state_record state;
+        uint8_t len;
+
+        if (!journal.read(STATE_JOURNAL_KEY, &state, sizeof(state), &len) ||
+            len != sizeof(state) || state.patch >= NUM_PATCHES)
+                return false;
+
+        if (state.patch / 10 != current_bank)
+                load_bank(state.patch / 10);
+
+        current_patch = state.patch % 10;
+        rgbstrp.set(state.color.rgb);
+#ifndef NO_MAIN_STRIP
+        mainstrp.set(state.color.M);
+#endif
+
+        return true;
+}
+
+/* save_state
+ * ----------
+ * Description:
+ *      Coalesces changes of the live state and writes it to the journal
+ *      once it has settled for STATE_SAVE_DELAY. Fades and potentiometer
+ *      sweeps thus result in a single record, and states that don't differ
+ *      from the last saved one aren't written at all.
+ */
+
+void save_state()
+{
+        state_record state = get_state();
+
+        if (state_changed(state, pending_state)) {
+                pending_state = state;
+                timers.start(state_timer, STATE_SAVE_DELAY);
+                return;
+        }
+
+        if (!timers.expired(state_timer) || !state_changed(state, saved_state))
+                return;
+
+        journal.write(STATE_JOURNAL_KEY, &state, sizeof(state));
+        saved_state = state;
+        pending_state = state;
+}
+
+//////////////////////////////
+// Settings
+//////////////////////////////
+
+/* get_setting
+ * -----------
+ * Arguments:
+ *      entry - Settings table entry
+ * Returns:
+ *      The current value of the setting
+ */
+
+uint16_t get_setting(const setting &entry)
+{
+        const uint8_t *field = (const uint8_t *) &settings + entry.offset;
+
+        return (entry.size == 1) ? *field : *(const uint16_t *) field;
+}
+
+/* set_setting
+ * -----------
+ * Arguments:
+ *      entry - Settings table entry
+ *      val - New value of the setting
+ */
+
+void set_setting(const setting &entry, uint16_t val)
+{
+        uint8_t *field = (uint8_t *) &settings + entry.offset;
+
+        if (entry.size == 1)
+                *field = val;
+        else
+                *(uint16_t *) field = val;
+}
+
+/* apply_settings
+ * --------------
+ * Description:
+ *      Passes the settings on to the objects that keep their own copy.
+ *      All other settings are read from the settings record where needed.
+ */
+
+void apply_settings()
+{
+        patch_encoder.set_debounce_time(settings.debounce_time);
+        movement.set_sigmas(settings.pot_mov_sigmas);
+        movement.set_floor(settings.pot_max_dev);
+
+        for (uint8_t i = 0; i < 4; i++)
+                pot_filters[i].set_lower_bound(settings.pot_lower_bound[i]);
+}
+
+/* load_settings
+ * -------------
+ * Description:
+ *      Loads the settings from the journal. Settings that have never been
+ *      changed (ex. on a new device), are missing from the record or are out
+ *      of their valid range take the compile-time defaults from config.h.
+ */
+
+void load_settings()
+{
+        settings_record defaults;
+
+        memcpy_P(&defaults, &default_settings, sizeof(defaults));
+        settings = defaults;
+
+        journal.read(SETTINGS_JOURNAL_KEY, &settings, sizeof(settings));
+
+        for (uint8_t i = 0; i < NUM_SETTINGS; i++) {
+                setting entry;
+                uint16_t val;
+
+                memcpy_P(&entry, &settings_table[i], sizeof(entry));
+                val = get_setting(entry);
+
+                if (val < entry.min || val > entry.max)
+                        memcpy((uint8_t *) &settings + entry.offset, (uint8_t *) &defaults + entry.offset, entry.size);
+        }
+
+        apply_settings();
+}
+
+/* print_settings
+ * --------------
+ * Description:
+ *      Prints the name, value and valid range of every setting to the serial console
+ */
+
+void print_settings()
+{
+        for (uint8_t i = 0; i < NUM_SETTINGS; i++) {
+                setting entry;
+
+                memcpy_P(&entry, &settings_table[i], sizeof(entry));
+                Serial.println(String(entry.name) + ": " + String(get_setting(entry)) +
+                               " (" + String(entry.min) + " - " + String(entry.max) + ")");
+        }
+}
+
+//////////////////////////////
+// Potentiometer calibration
+//////////////////////////////
+
+/* calibration_crc
+ * ---------------
+ * Arguments:
+ *      rec - Calibration record
+ * Returns:
+ *      The CRC-8 (CCITT polynomial, initial value 0xFF) of the record, excluding its CRC
+ */
+
+uint8_t calibration_crc(const calibration_record &rec)
+{
+        const uint8_t *data = (const uint8_t *) &rec;
+        uint8_t crc = 0xFF;
+
+        for (uint8_t i = 0; i < offsetof(calibration_record, crc); i++)
+                crc = _crc8_ccitt_update(crc, data[i]);
+
+        return crc;
+}
+
+/* apply_calibration
+ * -----------------
+ * Description:
+ *      Maps the range between the calibrated end points of every potentiometer,
+ *      less POT_CALIBRATION_GUARD at both ends, to the full scale of its filter chain.
+ *      Uncalibrated potentiometers are left unchanged.
+ */
+
+void apply_calibration()
+{
+        for (uint8_t i = 0; i < 4; i++) {
+                uint16_t low = calibration.low[i];
+                uint16_t high = ANALOG_READ_MAX - calibration.high[i];
+
+                if (low == 0 && high == ANALOG_READ_MAX) {
+                        pot_filters[i].set_range(0, POT_FILTER_FULL_SCALE);
+                        continue;
+                }
+
+                low = low + POT_CALIBRATION_GUARD;
+                high = high - POT_CALIBRATION_GUARD;
+                pot_filters[i].set_range(low << 6, high << 6);
+        }
+}
+
+/* load_calibration
+ * ----------------
+ * Description:
+ *      Loads the potentiometer calibration from EEPROM. Units that have never
+ *      been calibrated (or whose calibration is corrupted) remain uncalibrated.
+ */
+
+void load_calibration()
+{
+        async_eeprom.get(EEPROM_CALIBRATION_ADDR, calibration);
+
+        if (calibration.crc != calibration_crc(calibration))
+                memset(&calibration, 0, sizeof(calibration));
+
+        apply_calibration();
+}
+
+/* print_calibration
+ * -----------------
+ * Description:
+ *      Prints the calibrated ADC range of every potentiometer to the serial console
+ */
+
+void print_calibration()
+{
+        const char names[] = "RGBM";
+
+        for (uint8_t i = 0; i < 4; i++) {
+                Serial.println(String(names[i]) + ": " + String(calibration.low[i]) + " - " +
+                               String(ANALOG_READ_MAX - calibration.high[i]));
+        }
+}
+
+/* start_calibration
+ * -----------------
+ * Description:
+ *      Starts recording the end points of all potentiometers. The lights follow
+ *      the potentiometers during the calibration. This function is triggered by
+ *      holding the rotary encoder down during boot, or via serial.
+ */
+
+void start_calibration()
+{
+        memset(&cal_progress, 0xFF, sizeof(cal_progress));
+        calibrating = true;
+
+        take_over(all_channels);
+        patch_indicator.blink(1, settings.blink_on, settings.blink_off);
+        Serial.println("Calibrating, turn all potentiometers to both ends");
+}
+
+/* track_calibration
+ * -----------------
+ * Description:
+ *      Records the extremes of the potentiometers during a calibration.
+ *      Must be called for every potentiometer sample.
+ */
+
+void track_calibration()
+{
+        for (uint8_t i = 0; i < 4; i++) {
+                uint8_t low = min(pot_filters[i].raw() >> 6, 254);
+                uint8_t high = min((POT_FILTER_FULL_SCALE - pot_filters[i].raw()) >> 6, 254);
+
+                cal_progress.low[i] = min(cal_progress.low[i], low);
+                cal_progress.high[i] = min(cal_progress.high[i], high);
+        }
+}
+
+/* store_calibration
+ * -----------------
+ * Description:
+ *      Applies the calibration and writes it to EEPROM
+ */
+
+void store_calibration()
+{
+        calibration.crc = calibration_crc(calibration);
+        async_eeprom.put(EEPROM_CALIBRATION_ADDR, calibration);
+        apply_calibration();
+}
+
+/* finish_calibration
+ * ------------------
+ * Description:
+ *      Ends the calibration and stores the recorded end points. Potentiometers
+ *      that haven't been turned to both ends, that is whose end points are less
+ *      than POT_CALIBRATION_MIN_SPAN apart, keep their previous calibration.
+ *      This function is triggered by long pressing the rotary encoder during
+ *      a calibration, or via serial.
+ */
+
+void finish_calibration()
+{
+        const char names[] = "RGBM";
+
+        calibrating = false;
+
+        for (uint8_t i = 0; i < 4; i++) {
+                uint8_t low = cal_progress.low[i];
+                uint8_t high = cal_progress.high[i];
+
+                // Margins are capped at 254, so an end at or past the cap hasn't been reached
+                if (low >= 254 || high >= 254 || ANALOG_READ_MAX - low - high < POT_CALIBRATION_MIN_SPAN) {
+                        Serial.println(String(names[i]) + " hasn't been turned to both ends, keeping its calibration");
+                        continue;
+                }
+
+                calibration.low[i] = cal_progress.low[i];
+                calibration.high[i] = cal_progress.high[i];
+        }
+
+        store_calibration();
+        print_calibration();
+        patch_indicator.blink(settings.save_blinks, settings.blink_on, settings.blink_off);
+}
+
+/* calibration_cmd
+ * ---------------
+ * Arguments:
+ *      cmd - Serial command
+ * Returns:
+ *      True, if the command has been recognized
+ * Description:
+ *      Handles the calibration commands:
+ *       - k: Starts a calibration, or ends the running calibration
+ *       - kclear: Removes the calibration of all potentiometers
+ */
+
+bool calibration_cmd(String cmd)
+{
+        if (cmd == CALIBRATE_CMD) {
+                if (calibrating)
+                        finish_calibration();
+                else
+                        start_calibration();
+        } else if (cmd == UNCALIBRATE_CMD) {
+                calibrating = false;
+                memset(&calibration, 0, sizeof(calibration));
+                store_calibration();
+                print_calibration();
+        } else {
+                return false;
+        }
+
+        return true;
+}
+
+//////////////////////////////
+// Gesture recorder
+//////////////////////////////
+
+/* play_gesture
+ * ------------
+ * Returns:
+ *      True, if the stored gesture is played back
+ * Description:
+ *      Plays the stored gesture in a loop until the potentiometers
+ *      are turned or another patch or color is selected.
+ */
+
+bool play_gesture()
+{
+        crossfade.stop();
+
+        if (!gesture.play())
+                return false;
+
+        program_all();
+        return true;
+}
+
+/* record_gesture
+ * --------------
+ * Description:
+ *      Starts recording the potentiometer movement. The lights follow the
+ *      potentiometers during the recording. This function is triggered by
+ *      double clicking the rotary encoder.
+ */
+
+void record_gesture()
+{
+        take_over(all_channels);
+        gesture.start_recording((const uint8_t *) &rgbmpots);
+        patch_indicator.blink(1, settings.blink_on, settings.blink_off);
+        Serial.println("Recording gesture");
+}
+
+/* stop_gesture
+ * ------------
+ * Description:
+ *      Stops the recording, stores the gesture and starts playing it back.
+ *      This function is triggered by clicking the rotary encoder during
+ *      a recording, or when the EEPROM space of the gesture is full.
+ */
+
+void stop_gesture()
+{
+        if (!gesture.stop_recording())
+                return;
+
+        Serial.println("Gesture recorded");
+        patch_indicator.blink(settings.save_blinks, settings.blink_on, settings.blink_off);
+        play_gesture();
+}
+
+//////////////////////////////
+// Boot message
+//////////////////////////////
+
+/* banner_tx
+ * ---------
+ * Arguments:
+ *      finish - Blocks until the boot message has been sent completely
+ * Description:
+ *      Passes as much of the boot message to the serial port as its transmit buffer
+ *      takes without blocking. At 9600 baud the message takes over half a second, so
+ *      it is streamed from the main loop instead of delaying the boot. Before anything
+ *      else is printed, the rest of the message is sent with finish set.
+ */
+
+void banner_tx(bool finish = false)
+{
+        while (banner_pos) {
+                int room = Serial.availableForWrite();
+
+                if (room == 0 && !finish)
+                        return;
+
+                do {
+                        char c = pgm_read_byte(banner_pos);
+
+                        if (c == '\0') {
+                                banner_pos = NULL;
+                                return;
+                        }
+
+                        Serial.write(c);
+                        banner_pos++;
+                } while (--room > 0);
+        }
+}
+
+///////////////////////
+// Color via serial
+///////////////////////
+
+/* print_rgbm
+ * ----------
+ * Arguments:
+ *      rgbm - rgbm object to be printed
+ * Description:
+ *      Prints rgbm values to the serial console 
+ */
+
+void print_rgbm(rgbm rgbm)
+{
+        String rgb_hex[4] { String(rgbm.rgb.R, HEX), String(rgbm.rgb.G, HEX), String(rgbm.rgb.B, HEX), String(rgbm.M, HEX)};
+
+        for (uint8_t i = 0; i < 4; i++) {
+                if (rgb_hex[i].length() == 1)
+                        rgb_hex[i] = "0" + rgb_hex[i];
+        }
+
+        Serial.println("Current Color: #" + rgb_hex[0] + rgb_hex[1] + rgb_hex[2] + rgb_hex[3]);
+        Serial.println("R: " + String(rgbm.rgb.R));
+        Serial.println("G: " + String(rgbm.rgb.G));
+        Serial.println("B: " + String(rgbm.rgb.B));
+        Serial.println("M: " + String(rgbm.M));
+}
+
+/* hexstr_to_uint32
+ * ----------
+ * Arguments:
+ *      *_hex - A return pointer to a uint32_t 
+ *      hexstr - A string of hex characters (without 0x prefix)
+ * Returns:
+ *      True - hex string has successfully been converted to uin32_t
+ *      False - Invalid hex character found 
+ * Description:
+ *      Converts a hex string without prefixes ("0x" etc.) to
+ *      a 32 bit value uint32_t. If an invalid hex has been provided,
+ *      false is returned.
+ */
+
+bool hexstr_to_uint32(String hexstr, uint32_t *_hex)
+{
+        uint32_t hex = 0;
+
+        for (size_t i = 0; i < hexstr.length(); i++) {
+                if (hexstr[i] >= '0' && hexstr[i] <= '9')
+                        hex += (hexstr[i] - 0x30) * uint32_pow(16, (hexstr.length() - 1 - i));
+                else if (hexstr[i] >= 'A' && hexstr[i] <= 'F')
+                        hex += (hexstr[i] - 55) * uint32_pow(16, (hexstr.length() - 1 - i));
+                else if (hexstr[i] >= 'a' && hexstr[i] <= 'f')
+                        hex += (hexstr[i] - 87) * uint32_pow(16, (hexstr.length() - 1 - i));
+                else
+                        return false;
+        }
+
+        *_hex = hex;
+        return true;
+}
+
+/* hexstr_to_rgb
+ * ----------
+ * Arguments:
+ *      hex - A rgb hex string (ex. #AABBCC) 
+ *      rgb - RgbColor return pointer 
+ * Returns:
+ *      True - hex string has successfully been parsed to RgbColor object
+ *      False - Invalid hex string
+ * Description:
+ *      Parses a RGB hex string (frequently known as html color codes)
+ *      to a NeoPixel RgbColor object. If an invalid hex code is provided,
+ *      false is returned.
+ */
+
+bool hexstr_to_rgb(String hex, RgbColor *rgb)
+{
+        uint32_t rgb_hex;
+        bool valid;
+
+        if (hex[0] != '#')
+                return false;
+
+        valid = hexstr_to_uint32(hex.substring(1, RGB_HEX_STR_LEN), &rgb_hex);
+        
+        if (valid)
+                *rgb = HtmlColor(rgb_hex);
+        
+        return valid;
+}
+
+/* hexstr_to_rgbm
+ * ----------
+ * Arguments:
+ *      hex - A rgbm hex string (ex. #AABBCCDD) 
+ *      rgbn - rgbm return pointer 
+ * Returns:
+ *      True - hex string has successfully been parsed to rgbm object
+ *      False - Invalid hex string
+ * Description:
+ *      Parses a RGBM hex string to a rgbm object. If an invalid hex
+ *      code is provided,, false is returned.
+ */
+bool hexstr_to_rgbm(String hex, rgbm *rgbm)
+{
+        RgbColor rgb;
+        uint32_t m;
+
+        String rgb_hex;
+        String m_hex;
+
+        if (hex[0] != '#')
+                return false;
+
+        rgb_hex = hex.substring(0, RGB_HEX_STR_LEN);
+
+        if (!hexstr_to_rgb(rgb_hex, &rgb))
+                return false;
+        
+        rgbm->rgb = rgb;
+        
+        m_hex = hex.substring(RGB_HEX_STR_LEN, RGBM_HEX_STR_LEN);
+        
+        if (!hexstr_to_uint32(m_hex, &m))
+                return false;
+
+        rgbm->M = m;
+        return true;
+}
+
+#ifdef BAM_STRIPS
+
+/* print_zones
+ * -----------
+ * Description:
+ *      Prints the brightness of all additional main light zones
+ *      as well as the CPU load of the BAM driver to the serial console
+ */
+
+void print_zones()
+{
+        uint16_t load = bamstrps.load();
+
+        for (uint8_t i = 0; i < bamstrps.channels(); i++)
+                Serial.println("Z" + String(i) + ": " + String(bamstrps.get(i)));
+
+        Serial.println("BAM load: " + String(load / 10) + "." + String(load % 10) + "%");
+}
+
+/* hexstr_to_zone
+ * --------------
+ * Arguments:
+ *      cmd - A zone command string (ex. z1AA)
+ * Returns:
+ *      True - Zone command has successfully been applied
+ *      False - Invalid zone command
+ * Description:
+ *      Parses a zone command, consisting of a 'z', the zone number and a
+ *      brightness byte as two hex characters, and dims the zone accordingly.
+ */
+
+bool hexstr_to_zone(String cmd)
+{
+        uint32_t bright;
+        uint8_t zone = cmd[1] - '0';
+
+        if (cmd[0] != 'z' || zone >= bamstrps.channels())
+                return false;
+
+        if (!hexstr_to_uint32(cmd.substring(2, ZONE_CMD_STR_LEN), &bright))
+                return false;
+
+        bamstrps.set(zone, bright);
+        return true;
+}
+
+#endif
+
+/* curve_cmd
+ * ---------
+ * Arguments:
+ *      cmd - A curve command string (ex. cm2)
+ * Returns:
+ *      True - Curve command has successfully been applied
+ *      False - Invalid curve command
+ * Description:
+ *      Parses a curve command, consisting of a 'c', the output channel
+ *      (r, g, b or m) and the number of the brightness curve
+ *      (0 = linear, 1 = gamma, 2 = CIE lightness), and applies the
+ *      curve to the channel.
+ */
+
+bool curve_cmd(String cmd)
+{
+        uint8_t num = cmd[2] - '0';
+        curve_type curve = (curve_type) num;
+
+        if (cmd[0] != 'c' || num >= num_curves)
+                return false;
+
+        switch (cmd[1]) {
+                case 'r':
+                        rgbstrp.set_curve(channel_r, curve);
+                        break;
+                case 'g':
+                        rgbstrp.set_curve(channel_g, curve);
+                        break;
+                case 'b':
+                        rgbstrp.set_curve(channel_b, curve);
+                        break;
+                case 'm':
+                        mainstrp.set_curve(curve);
+                        break;
+                default:
+                        return false;
+        }
+
+        return true;
+}
+
+/* bank_crc
+ * --------
+ * Arguments:
+ *      block - Bank transfer block
+ * Returns:
+ *      The CRC-8 (CCITT polynomial, initial value 0xFF) of the block, excluding its CRC
+ */
+
+uint8_t bank_crc(const uint8_t *block)
+{
+        uint8_t crc = 0xFF;
+
+        for (uint8_t i = 0; i < BANK_BLOCK_SIZE - 1; i++)
+                crc = _crc8_ccitt_update(crc, block[i]);
+
+        return crc;
+}
+
+/* export_banks
+ * ------------
+ * Description:
+ *      Prints the patches of all banks to the serial console, one bank
+ *      command (See bank_cmd) per bank, followed by the import command.
+ *      The output can be sent back to a device as is to restore or
+ *      provision its patches.
+ */
+
+void export_banks()
+{
+        for (uint8_t bank = 0; bank < NUM_BANKS; bank++) {
+                uint8_t block[BANK_BLOCK_SIZE];
+
+                block[0] = bank;
+
+                for (uint8_t i = 0; i < 10; i++) {
+                        patch_record rec;
+
+                        read_patch(patch_key(bank, i), &rec.color, &rec.fade);
+                        memcpy(&block[1 + i * sizeof(patch_record)], &rec, sizeof(patch_record));
+                }
+
+                block[BANK_BLOCK_SIZE - 1] = bank_crc(block);
+
+                Serial.print('p');
+
+                for (uint8_t i = 0; i < BANK_BLOCK_SIZE; i++) {
+                        if (block[i] < 0x10)
+                                Serial.print('0');
+
+                        Serial.print(block[i], HEX);
+                }
+
+                Serial.println();
+        }
+
+        Serial.println(IMPORT_CMD);
+}
+
+/* bank_cmd
+ * --------
  * Arguments:
- *      rgbmpots - rgbm object with current potentiometer values
- *      avg - rgbm object with average potentiometer values 
- *      max_dev - Max deviation from average (max_dev = |current pots value - avg|)
+ *      cmd - A bank command string (ex. p00FF00000080FF...)
  * Returns:
- *      True - Potentiometer movement detected (Pot value exceeded the maximum deviation from the average)
- *      False - No significant potentiometer movement detected 
+ *      True - Bank command is valid
+ *      False - Invalid bank command
  * Description:
- *      Detects between noise and real potentiometer movement.
- *      Returns true if significant potentiometer movement has been detected.
+ *      Parses a bank command, consisting of a 'p' followed by a hex encoded
+ *      block of the bank number, the 10 patches of the bank as {R, G, B, M, fade}
+ *      and a CRC-8 of all previous bytes, as printed by export_banks().
+ *      Validated banks are only staged in RAM, nothing is written before
+ *      import_banks() is invoked by the import command, which imports every
+ *      bank on its own.
  */
 
-inline bool rgbm_pot_mov_det(rgbm rgbmpots, rgbm avg, uint8_t max_dev)
+bool bank_cmd(String cmd)
 {
-        return (
-                abs(rgbmpots.rgb.R - avg.rgb.R) > max_dev ||
-                abs(rgbmpots.rgb.G - avg.rgb.G) > max_dev ||
-                abs(rgbmpots.rgb.B - avg.rgb.B) > max_dev
-#ifndef NO_MAIN_STRIP
-                || abs(rgbmpots.M - avg.M) > max_dev
-#endif
-        );
-}
+        uint8_t block[BANK_BLOCK_SIZE];
 
-//////////////////////////////
-// Global vars & Objects
-//////////////////////////////
-
-// LED Strips
-uint8_t mainstrp_bright; // Current brightness of main light strip
+        if (cmd[0] != 'p' || cmd.length() != BANK_CMD_STR_LEN)
+                return false;
 
-#if RGB_STRIP_TYPE == ADDRESSABLE
-RGBStrip rgbstrp(RGB_STRIP_LEDS, RGB_STRIP);
-#else
-RGBStrip rgbstrp(RGB_STRIP_R, RGB_STRIP_G, RGB_STRIP_B);
-#endif
+        for (uint8_t i = 0; i < BANK_BLOCK_SIZE; i++) {
+                uint32_t byte;
 
-rgbm rgbmpots; // Stores current potentiometer values
-rgbm avg; // Stores average potentiometer values
+                if (!hexstr_to_uint32(cmd.substring(1 + i * 2, 3 + i * 2), &byte))
+                        return false;
 
-rgbm patches[10]; // Patches/Slots of RGBM configurations
-uint8_t current_patch; // Currently selected patch
+                block[i] = byte;
+        }
 
-// Rotary Encoder
-PatchEncoder patch_encoder(ROTARY_ENC_DT, ROTARY_ENC_CLK, ROTARY_ENC_SW, ROTARY_ENC_DEBOUCE_TIME);
+        if (block[0] >= NUM_BANKS || block[BANK_BLOCK_SIZE - 1] != bank_crc(block))
+                return false;
 
-// 7 Segment patch indicator
-PatchIndicator patch_indicator (
-        SEV_SEG_COMMON_MODE, 
-        SEV_SEG_COMMON,
-        SEV_SEG_A, 
-        SEV_SEG_B, 
-        SEV_SEG_C, 
-        SEV_SEG_D, 
-        SEV_SEG_E, 
-        SEV_SEG_F, 
-        SEV_SEG_G,
-        SEV_SEG_DP
-);
+        // The staging buffer only occupies RAM while an import is in progress
+        if (!staged_banks) {
+                staged_banks = (patch_record *) malloc(NUM_PATCHES * sizeof(patch_record));
+                staged_mask = 0;
 
-// External color programming
+                if (!staged_banks) {
+                        Serial.println("Out of memory!");
+                        return true;
+                }
+        }
 
-// When set to true, the device will maintain its current color
-// until potentiometer movement is detected
-bool programmed = false;
+        memcpy(&staged_banks[block[0] * 10], &block[1], 10 * sizeof(patch_record));
+        staged_mask |= 1 << block[0];
 
-///////////////////////
-// Color via serial
-///////////////////////
+        Serial.println("Bank " + String(block[0]) + " staged, send " IMPORT_CMD " to import (each bank is imported as a whole or not at all)");
+        return true;
+}
 
-/* print_rgbm
- * ----------
- * Arguments:
- *      rgbm - rgbm object to be printed
+/* import_banks
+ * ------------
  * Description:
- *      Prints rgbm values to the serial console 
+ *      Writes every staged bank to the journal in a transaction of its own, so
+ *      either all or none of a bank's patches are stored, even if the power fails
+ *      midway. The journal only keeps room for the superseded patches of a single
+ *      bank (See JOURNAL_TXN_BLOCKS), hence the banks are imported one at a time.
+ *      Patches that remain unchanged aren't written. A bank that doesn't fit
+ *      is rolled back as a whole and reported, the other banks are still imported.
  */
 
-void print_rgbm(rgbm rgbm)
+void import_banks()
 {
-        String rgb_hex[4] { String(rgbm.rgb.R, HEX), String(rgbm.rgb.G, HEX), String(rgbm.rgb.B, HEX), String(rgbm.M, HEX)};
+        for (uint8_t bank = 0; bank < NUM_BANKS; bank++) {
+                journal_index committed;
+                bool stored;
 
-        for (uint8_t i = 0; i < 4; i++) {
-                if (rgb_hex[i].length() == 1)
-                        rgb_hex[i] = "0" + rgb_hex[i];
+                if (!(staged_mask & (1 << bank)))
+                        continue;
+
+                if (!journal.begin_transaction(&committed)) {
+                        Serial.println("Patch storage is full, bank " + String(bank) + " not imported!");
+                        continue;
+                }
+
+                stored = true;
+
+                for (uint8_t i = 0; i < 10 && stored; i++) {
+                        uint8_t key = patch_key(bank, i);
+                        patch_record cur;
+
+                        read_patch(key, &cur.color, &cur.fade);
+
+                        if (memcmp(&cur, &staged_banks[key], sizeof(patch_record)) != 0)
+                                stored = write_patch(key, staged_banks[key].color, staged_banks[key].fade);
+                }
+
+                if (stored) {
+                        journal.commit_transaction();
+                        Serial.println("Bank " + String(bank) + " imported");
+
+                        if (bank == current_bank)
+                                load_bank(current_bank);
+                } else {
+                        journal.abort_transaction();
+                        Serial.println("Patch storage is full, bank " + String(bank) + " not imported!");
+                }
         }
 
-        Serial.println("Current Color: #" + rgb_hex[0] + rgb_hex[1] + rgb_hex[2] + rgb_hex[3]);
-        Serial.println("R: " + String(rgbm.rgb.R));
-        Serial.println("G: " + String(rgbm.rgb.G));
-        Serial.println("B: " + String(rgbm.rgb.B));
-        Serial.println("M: " + String(rgbm.M));
+        free(staged_banks);
+        staged_banks = NULL;
 }
 
-/* hexstr_to_uint32
- * ----------
+/* fade_cmd
+ * --------
  * Arguments:
- *      *_hex - A return pointer to a uint32_t 
- *      hexstr - A string of hex characters (without 0x prefix)
+ *      cmd - A fade command string (ex. f15)
  * Returns:
- *      True - hex string has successfully been converted to uin32_t
- *      False - Invalid hex character found 
+ *      True - Fade command has successfully been applied
+ *      False - Invalid fade command
  * Description:
- *      Converts a hex string without prefixes ("0x" etc.) to
- *      a 32 bit value uint32_t. If an invalid hex has been provided,
- *      false is returned.
+ *      Parses a fade command, consisting of an 'f' followed by the fade time
+ *      in tenths of a second (0 - 254), and permanently assigns the fade time
+ *      to the currently selected patch.
  */
 
-bool hexstr_to_uint32(String hexstr, uint32_t *_hex)
+bool fade_cmd(String cmd)
 {
-        uint32_t hex = 0;
+        long fade;
 
-        for (size_t i = 0; i < hexstr.length(); i++) {
-                if (hexstr[i] >= '0' && hexstr[i] <= '9')
-                        hex += (hexstr[i] - 0x30) * uint32_pow(16, (hexstr.length() - 1 - i));
-                else if (hexstr[i] >= 'A' && hexstr[i] <= 'F')
-                        hex += (hexstr[i] - 55) * uint32_pow(16, (hexstr.length() - 1 - i));
-                else if (hexstr[i] >= 'a' && hexstr[i] <= 'f')
-                        hex += (hexstr[i] - 87) * uint32_pow(16, (hexstr.length() - 1 - i));
-                else
+        if (cmd[0] != 'f' || cmd.length() < 2)
+                return false;
+
+        for (size_t i = 1; i < cmd.length(); i++) {
+                if (cmd[i] < '0' || cmd[i] > '9')
                         return false;
         }
 
-        *_hex = hex;
+        fade = cmd.substring(1).toInt();
+
+        if (fade >= NO_FADE_TIME)
+                return false;
+
+        fades[current_patch] = fade;
+        store_patch(current_patch);
         return true;
 }
 
-/* hexstr_to_rgb
- * ----------
+/* settings_cmd
+ * ------------
  * Arguments:
- *      hex - A rgb hex string (ex. #AABBCC) 
- *      rgb - RgbColor return pointer 
+ *      cmd - A settings command string (ex. smax_dev=8)
  * Returns:
- *      True - hex string has successfully been parsed to RgbColor object
- *      False - Invalid hex string
+ *      True - Settings command is valid
+ *      False - Invalid settings command, unknown setting or value out of range
  * Description:
- *      Parses a RGB hex string (frequently known as html color codes)
- *      to a NeoPixel RgbColor object. If an invalid hex code is provided,
- *      false is returned.
+ *      Parses a settings command. An 's' on its own prints all settings,
+ *      "sdefaults" restores the defaults of all settings, and an 's' followed
+ *      by the name of a setting, a '=' and a decimal value changes a setting.
+ *      Changed settings are applied immediately and stored permanently.
  */
 
-bool hexstr_to_rgb(String hex, RgbColor *rgb)
+bool settings_cmd(String cmd)
 {
-        uint32_t rgb_hex;
-        bool valid;
+        int sep = cmd.indexOf('=');
+        String name;
+        String val;
 
-        if (hex[0] != '#')
+        if (cmd[0] != 's')
                 return false;
 
-        valid = hexstr_to_uint32(hex.substring(1, RGB_HEX_STR_LEN), &rgb_hex);
-        
-        if (valid)
-                *rgb = HtmlColor(rgb_hex);
-        
-        return valid;
-}
-
-/* hexstr_to_rgbm
- * ----------
- * Arguments:
- *      hex - A rgbm hex string (ex. #AABBCCDD) 
- *      rgbn - rgbm return pointer 
- * Returns:
- *      True - hex string has successfully been parsed to rgbm object
- *      False - Invalid hex string
- * Description:
- *      Parses a RGBM hex string to a rgbm object. If an invalid hex
- *      code is provided,, false is returned.
- */
-bool hexstr_to_rgbm(String hex, rgbm *rgbm)
-{
-        RgbColor rgb;
-        uint32_t m;
+        if (cmd.length() == 1) {
+                print_settings();
+                return true;
+        }
 
-        String rgb_hex;
-        String m_hex;
+        if (cmd == DEFAULTS_CMD) {
+                memcpy_P(&settings, &default_settings, sizeof(settings));
+                apply_settings();
+                journal.write(SETTINGS_JOURNAL_KEY, &settings, sizeof(settings));
+                print_settings();
+                return true;
+        }
 
-        if (hex[0] != '#')
+        if (sep < 2)
                 return false;
 
-        rgb_hex = hex.substring(0, RGB_HEX_STR_LEN);
+        name = cmd.substring(1, sep);
+        val = cmd.substring(sep + 1);
 
-        if (!hexstr_to_rgb(rgb_hex, &rgb))
-                return false;
-        
-        rgbm->rgb = rgb;
-        
-        m_hex = hex.substring(RGB_HEX_STR_LEN, RGBM_HEX_STR_LEN);
-        
-        if (!hexstr_to_uint32(m_hex, &m))
+        if (val.length() == 0 || val.length() > 5)
                 return false;
 
-        rgbm->M = m;
-        return true;
+        for (size_t i = 0; i < val.length(); i++) {
+                if (val[i] < '0' || val[i] > '9')
+                        return false;
+        }
+
+        for (uint8_t i = 0; i < NUM_SETTINGS; i++) {
+                setting entry;
+                long v = val.toInt();
+
+                memcpy_P(&entry, &settings_table[i], sizeof(entry));
+
+                if (name != entry.name)
+                        continue;
+
+                if (v < entry.min || v > entry.max)
+                        return false;
+
+                if (v != get_setting(entry)) {
+                        set_setting(entry, v);
+                        apply_settings();
+
+                        if (!journal.write(SETTINGS_JOURNAL_KEY, &settings, sizeof(settings)))
+                                Serial.println("Settings storage is full!");
+                }
+
+                Serial.println(name + ": " + String(v));
+                return true;
+        }
+
+        return false;
 }
 
 /*
@@ -413,22 +2162,56 @@ bool hexstr_to_rgbm(String hex, rgbm *rgbm)
  *      - When a RGB html value (ex. #AABBCC) is received, the RGB strip is programmed to that color
  *      - When a RGBM (RGBA) html value is received (ex. #AABBCCDD), the RGB strip and main light is programmed to that value.
  *        The main light strip brightness is controlled by the last two hex numbers.
+ *      - When a fade command is received (ex. f15), the fade time of the current patch is changed.
+ *      - When a curve command is received (ex. cm2), the brightness curve of the
+ *        given output channel is changed.
+ *      - When a zone command is received (ex. z1AA), the additional main light zone
+ *        is dimmed to the provided brightness byte.
+ *      - When the export command (x) is received, the patches of all banks are emitted as bank commands.
+ *      - When a bank command is received (ex. p00FF...), all patches of a bank are replaced.
+ *      - When the play command (r) is received, the recorded gesture is played back.
+ *      - When a settings command is received (ex. smax_dev=8), a firmware setting is
+ *        printed, changed or reset (See settings_cmd).
  */
 
 void serialEvent()
 {
         static String cmdbuf = "";
+
+        // Replies must not interleave with the boot message
+        banner_tx(true);
+
         while(Serial.available()) {
                 char c = (char)Serial.read();
 
                 switch (c) {
                         case 'g': {
+                                // 'g' may also be part of a command (ex. cg1)
+                                if (cmdbuf.length() > 0) {
+                                        cmdbuf += c;
+                                        break;
+                                }
+
                                 rgbm rgbm = {
                                         rgbstrp.get(), 
-                                        mainstrp_bright
+                                        mainstrp.get()
                                 };
                                 
                                 print_rgbm(rgbm);
+                                Serial.println("Patch: " + String(current_patch) + " (Bank " + String(current_bank) + ")");
+                                Serial.println("Fade: " + String(patch_fade_time(current_patch)) + " ms");
+                                Serial.println("Input: " + String(patch_encoder.overflows()) + " dropped, max. latency " +
+                                               String(patch_encoder.max_latency()) + " ms");
+                                Serial.println("Noise floor: R " + String(movement.noise_floor(0)) + " G " + String(movement.noise_floor(1)) +
+                                               " B " + String(movement.noise_floor(2)) + " M " + String(movement.noise_floor(3)));
+#ifdef IDLE_SLEEP
+                                Serial.println("Idle: " + String(idle_percent) + "%");
+#endif
+                                Serial.println("Boot: light after " + String(boot_light_us) + " us, input after " +
+                                               String(boot_ready_us) + " us");
+#ifdef BAM_STRIPS
+                                print_zones();
+#endif
                                 cmdbuf = "";
                                 break;
                         }
@@ -442,6 +2225,80 @@ void serialEvent()
                         case '\n': {
                                 bool valid = false;
 
+                                if (cmdbuf == PLAY_CMD) {
+                                        if (!play_gesture())
+                                                Serial.println("No gesture recorded!");
+
+                                        cmdbuf = "";
+                                        break;
+                                }
+
+                                if (cmdbuf == EXPORT_CMD) {
+                                        export_banks();
+                                        cmdbuf = "";
+                                        break;
+                                }
+
+                                if (cmdbuf == IMPORT_CMD) {
+                                        if (!staged_banks)
+                                                Serial.println("No banks staged!");
+                                        else
+                                                import_banks();
+
+                                        cmdbuf = "";
+                                        break;
+                                }
+
+                                if (cmdbuf[0] == 'p') {
+                                        if (!bank_cmd(cmdbuf))
+                                                Serial.println("Invalid bank command!");
+
+                                        cmdbuf = "";
+                                        break;
+                                }
+
+                                if (cmdbuf[0] == 'k') {
+                                        if (!calibration_cmd(cmdbuf))
+                                                Serial.println("Invalid calibration command!");
+
+                                        cmdbuf = "";
+                                        break;
+                                }
+
+                                if (cmdbuf[0] == 's') {
+                                        if (!settings_cmd(cmdbuf))
+                                                Serial.println("Invalid setting!");
+
+                                        cmdbuf = "";
+                                        break;
+                                }
+
+                                if (cmdbuf.length() <= FADE_CMD_STR_MAX && cmdbuf[0] == 'f') {
+                                        if (!fade_cmd(cmdbuf))
+                                                Serial.println("Invalid fade command!");
+
+                                        cmdbuf = "";
+                                        break;
+                                }
+
+                                if (cmdbuf.length() == CURVE_CMD_STR_LEN && cmdbuf[0] == 'c') {
+                                        if (!curve_cmd(cmdbuf))
+                                                Serial.println("Invalid curve command!");
+
+                                        cmdbuf = "";
+                                        break;
+                                }
+
+#ifdef BAM_STRIPS
+                                if (cmdbuf.length() == ZONE_CMD_STR_LEN && cmdbuf[0] == 'z') {
+                                        if (!hexstr_to_zone(cmdbuf))
+                                                Serial.println("Invalid zone command!");
+
+                                        cmdbuf = "";
+                                        break;
+                                }
+#endif
+
                                 if (cmdbuf.length() == RGB_HEX_STR_LEN) {
                                         RgbColor rgb;
                                         valid = hexstr_to_rgb(cmdbuf, &rgb);
@@ -457,16 +2314,15 @@ void serialEvent()
                                         if (valid) {
                                                 rgbstrp.set(rgbm.rgb);
 #ifndef NO_MAIN_STRIP
-                                                mainstrp_bright = rgbm.M;
-                                                analogWrite(MAIN_STRIP, mainstrp_bright);
+                                                mainstrp.set(rgbm.M);
 #endif
                                         }
                                 }
                                 
                                 if (valid) {
-                                        // Read average of pots for potentiometer movement detection 
-                                        avg = avg_rgbm_pot_read(R_POT, G_POT, B_POT, M_POT, POT_MOV_DET_AVG_SAMPLES);
-                                        programmed = true;
+                                        crossfade.stop();
+                                        gesture.stop();
+                                        program_all();
                                 } else {
                                         Serial.println("Invalid hex value!");
                                 }
@@ -483,82 +2339,79 @@ void serialEvent()
 }
 
 //////////////////////////////
-// Rotary Encoder Interrupts
+// Patch Selection
 //////////////////////////////
 
 /* change_patch
  * ------------
  * Parameters:
- *      up - If set true, the next patch is selected, if 
- *           set false, the previous patch is selected
+ *      steps - Number of patches to step forward (positive)
+ *              or backward (negative)
  * Description:
- *      Changes the patch to the next or previous one
+ *      Changes the patch by the given number of steps. Stepping past the
+ *      first or last patch of a bank pages to the adjacent bank, stepping
+ *      past the first or last patch of all banks stops at that patch.
+ *      The lights are crossfaded to the new patch over its fade time.
  */
 
-void change_patch(bool up)
+void change_patch(int8_t steps)
 {
-        bool invalid = false;
+        int16_t prev = patch_key(current_bank, current_patch);
+        int16_t patch = constrain(prev + steps, 0, NUM_PATCHES - 1);
 
-        if (up && current_patch < 9)
-                current_patch++;
-        else if (!up && current_patch > 0)
-                current_patch--;
-        else
-                invalid = true;
-  
-        if (!invalid) {
-                rgbstrp.set(patches[current_patch].rgb);
-#ifndef NO_MAIN_STRIP
-                mainstrp_bright = patches[current_patch].M;
-                analogWrite(MAIN_STRIP, mainstrp_bright);
-#endif
-                avg = avg_rgbm_pot_read(R_POT, G_POT, B_POT, M_POT, POT_MOV_DET_AVG_SAMPLES);
-                programmed = true;
+        if (patch != prev) {
+                if (patch / 10 != current_bank)
+                        load_bank(patch / 10);
+
+                current_patch = patch % 10;
+
+                gesture.stop();
+                fade_to_patch(current_patch);
+                program_all();
                 patch_indicator.set(current_patch);
+                patch_indicator.set_bank(current_bank);
         }
 
-        patch_indicator.show(PATCH_DISPLAY_TIME);
+        patch_indicator.show(settings.display_time);
 }
 
 /* patch_up
  * --------
  * Description:
- *      Selects next patch. This function is triggered
- *      by clock-wise rotary encoder movement.
+ *      Selects next patch.
  */
 
 void patch_up()
 {
-        change_patch(true);
+        change_patch(1);
 }
 
-/* patch_up
- * --------
+/* patch_dwn
+ * ---------
  * Description:
- *      Selects previous patch. This function is triggered
- *      by counter-clockwise rotary encoder movement.
+ *      Selects previous patch.
  */
 
 void patch_dwn()
 {
-        change_patch(false);
+        change_patch(-1);
 }
 
 /* save_patch
  * --------
  * Description:
  *      Saves current RGB and main light patch to the patch bank.
- *      This function is triggered by pressing the rotary encoder.
+ *      This function is triggered by holding down the rotary encoder for LONG_PRESS_TIME.
  */
 
 void save_patch()
 {
         patches[current_patch].rgb = rgbstrp.get();
-        patches[current_patch].M = mainstrp_bright;
-        EEPROM.put(EEPROM_PATCH_ADDR + (sizeof(rgbm) * current_patch), patches[current_patch]);
-        patch_indicator.blink(NUM_SAVE_BLINKS, BLINK_INTERVAL_ON, BLINK_INTERVAL_OFF);
-}
+        patches[current_patch].M = mainstrp.get();
 
+        if (store_patch(current_patch))
+                patch_indicator.blink(settings.save_blinks, settings.blink_on, settings.blink_off);
+}
 
 //////////////////////////////
 // Initialization
@@ -567,18 +2420,59 @@ void save_patch()
 /* setup
  * -----
  * Description:
- *      - Sets the potentiometer pin modes to INPUT
- *      - Sets the main light strip pin mode to OUTPUT
- *      - Prints the boot message (provided in config.h)
- *      - Loads the patches from the EEPROM
- *      - Initializes the RGB light strip from the values of the 0th patch
- *      - Initializes the main light strip from the values of the 0th patch
+ *      Restores the light first, so the room isn't left dark after a power cut:
+ *
+ *      - Applies the default brightness curves (provided in config.h)
+ *      - Loads the patches from the EEPROM journal (migrating legacy patch slots if necessary)
+ *      - Restores the outputs of the last session, or of the 0th patch on the first boot
+ *
+ *      Then the remaining hardware is brought up:
+ *
+ *      - Loads the firmware settings from the EEPROM journal
  *      - Initializes the 7 segment patch indicator
- *      - Initializes the rotary encoder
+ *      - Starts the BAM driver of the additional main light zones
+ *      - Sets the potentiometer pin modes to INPUT and loads their calibration
+ *      - Starts the rotary encoder decoder and the serial port
+ *
+ *      The boot message (provided in config.h) is streamed from the main loop.
+ *      The time until the first light and until the dimmer responds to input
+ *      are reported by the g command.
  */
 
 void setup()
 {
+        rgbstrp.set_curve(channel_r, R_CURVE);
+        rgbstrp.set_curve(channel_g, G_CURVE);
+        rgbstrp.set_curve(channel_b, B_CURVE);
+        mainstrp.set_curve(M_CURVE);
+
+        // Load patches from EEPROM into ram
+        load_patches();
+
+        // Resume the last session, or load the 0th patch on the first boot
+        if (!restore_state()) {
+                current_patch = 0;
+
+                rgbstrp.set(patches[current_patch].rgb);
+#ifndef NO_MAIN_STRIP
+                mainstrp.set(patches[current_patch].M);
+#endif
+        }
+
+        rgbstrp.commit();
+        boot_light_us = micros();
+
+        load_settings();
+
+        // 7-Segment Initialization
+        patch_indicator.set(current_patch);
+        patch_indicator.set_bank(current_bank);
+        patch_indicator.show(settings.display_time);
+
+#ifdef BAM_STRIPS
+        bamstrps.begin();
+#endif
+
 #ifdef NO_MAIN_STRIP
         pinMode(M_POT, INPUT_PULLUP);
 #else
@@ -588,33 +2482,31 @@ void setup()
         pinMode(G_POT, INPUT);
         pinMode(B_POT, INPUT);
 
-        pinMode(MAIN_STRIP, OUTPUT);
-
-        Serial.begin(9600);
-        Serial.println(String(BOOT_MSG_ASCII_ART) + "\n");
-        Serial.println("Author(s): " + String(BOOT_MSG_AUTHORS));
-        Serial.println("License: " + String(BOOT_MSG_LICENSE));
-        Serial.println("Build date: " + String(__DATE__));
-        Serial.println("Documentation: " + String(BOOT_MSG_SRC));
+        // Shorten the ADC conversions, so oversampled potentiometers don't stall the main loop
+        static_assert(POT_ADC_PRESCALER >= 16 && POT_ADC_PRESCALER <= 128 && !(POT_ADC_PRESCALER & (POT_ADC_PRESCALER - 1)),
+                      "POT_ADC_PRESCALER must be 16, 32, 64 or 128");
+        ADCSRA = (ADCSRA & ~(_BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0))) | __builtin_ctz(POT_ADC_PRESCALER);
 
-        // Load patches from EEPROM into ram
-        EEPROM.get(EEPROM_PATCH_ADDR, patches);
+        load_calibration();
 
-        // Load 0th patch on boot
-        current_patch = 0;
+        patch_encoder.begin();
+        Serial.begin(9600);
 
-        rgbstrp.set(patches[current_patch].rgb);
-#ifndef NO_MAIN_STRIP
-        mainstrp_bright = patches[current_patch].M;
-        analogWrite(MAIN_STRIP, mainstrp_bright); // Sets the brightness of the mainstrip
+        saved_state = get_state();
+        pending_state = saved_state;
+        timers.start(frame_timer, FRAME_INTERVAL, true);
+        timers.start(pot_timer, POT_SAMPLE_INTERVAL, true);
+#ifdef IDLE_SLEEP
+        timers.start(idle_timer, IDLE_REPORT_INTERVAL, true);
 #endif
+        rgbmpots = rgbm_pots_read(R_POT, G_POT, B_POT, M_POT, pot_filters);
 
-        // 7-Segment Initialization
-        patch_indicator.set(0);
-        patch_indicator.show(PATCH_DISPLAY_TIME);
+        program_all();
+
+        // The push button is checked for being held down once it has been debounced
+        timers.start(boot_timer, settings.debounce_time + 1);
 
-        avg = avg_rgbm_pot_read(R_POT, G_POT, B_POT, M_POT, POT_MOV_DET_AVG_SAMPLES);
-        programmed = true;
+        boot_ready_us = micros();
 }
 
 //////////////////////////////
@@ -627,12 +2519,16 @@ void setup()
  * Description:
  *      The main loop of the dimmer firmware.
  * 
- *       - Read the values of the RGB and main light potentiometers
+ *       - Samples the RGB and main light potentiometers through their filter chains
  *       - Checks if the light has been programmed (ex. by loading a patch or by applying a html code).
- *         If programmed, the RGB and main light are only changed if potentiometer movement is detected.
- *       - RGB light and main lights are set according to the potentiometers
+ *         If programmed, a channel is only changed once movement of its own potentiometer is detected.
+ *       - Channels that aren't programmed follow their potentiometers through the slew rate limiter
  *       - The rotary encoder is tested
  *       - The patch indicator is updated/handled
+ *       - Crossfades are advanced and the light outputs are committed at a fixed frame rate
+ *       - The live state is saved once it has settled
+ *       - The boot message is streamed to the serial console
+ *       - The CPU sleeps until the next interrupt if no timer is due
  * 
  *       Avoid implementing time intensive instructions/operations, as any delays
  *       will reduce the smoothness of the color transitions.
@@ -640,26 +2536,55 @@ void setup()
 
 void loop()
 {
-        rgbmpots = rgbm_pots_read(R_POT, G_POT, B_POT, M_POT);
+        if (timers.expired(pot_timer)) {
+                rgbmpots = rgbm_pots_read(R_POT, G_POT, B_POT, M_POT, pot_filters);
 
-        if (!programmed || rgbm_pot_mov_det(rgbmpots, avg, POT_MOV_DET_MAX_DEV)) {
-                rgbstrp.set(rgbmpots.rgb); // Set RGB strip
-#ifndef NO_MAIN_STRIP
-                mainstrp_bright = rgbmpots.M;
-                analogWrite(MAIN_STRIP, mainstrp_bright); // Set main light strip
-#endif
-                programmed = false;
+                uint8_t moved = rgbm_pot_mov_det(pot_filters, &movement);
+
+                if (programmed)
+                        take_over(pickup(moved));
+
+                if (calibrating)
+                        track_calibration();
+        }
+
+        encoder_action action = patch_encoder.action();
+
+        // Holding the rotary encoder down during boot starts a calibration. The hold
+        // would turn into a long press after LONG_PRESS_TIME and end the calibration
+        // right away, so only a new long press after the release can finish it.
+        if (timers.expired(boot_timer) && patch_encoder.held()) {
+                patch_encoder.ignore_press();
+                banner_tx(true);
+                start_calibration();
         }
 
-        switch (patch_encoder.action()) {
-                case pressed:
-                        save_patch();
+        // All actions but turns may print, so the boot message must be sent first
+        if (action != no_action && action != turned)
+                banner_tx(true);
+
+        switch (action) {
+                case clicked:
+                        if (gesture.recording())
+                                stop_gesture();
+                        else
+                                patch_indicator.show(settings.display_time);
                         break;
-                case left:
-                        change_patch(false);
+                case double_clicked:
+                        if (!gesture.recording() && !calibrating)
+                                record_gesture();
                         break;
-                case right:
-                        change_patch(true);
+                case long_pressed:
+                        if (calibrating)
+                                finish_calibration();
+                        else if (gesture.recording())
+                                stop_gesture();
+                        else
+                                save_patch();
+                        break;
+                case turned:
+                        if (!calibrating)
+                                change_patch(patch_encoder.steps());
                         break;
                 default:
                         break;
@@ -667,4 +2592,48 @@ void loop()
 
         if (patch_indicator.busy())
                 patch_indicator.update();
+
+        if (frame_due()) {
+                uint16_t levels[num_channels];
+                uint8_t live = ~programmed & all_channels;
+
+                if (gesture.recording() && !gesture.record((const uint8_t *) &rgbmpots))
+                        stop_gesture();
+
+                get_levels(levels);
+
+                if (crossfade.active())
+                        crossfade.step(levels);
+                else if (gesture.playing())
+                        gesture.step(levels);
+
+                // Channels that have been taken over follow their potentiometers
+                if (live) {
+                        uint16_t targets[num_channels];
+                        uint16_t slewed[num_channels];
+
+                        pot_levels(targets);
+                        slew.step(targets, slewed);
+
+                        for (uint8_t c = 0; c < num_channels; c++) {
+                                if (live & (1 << c))
+                                        levels[c] = slewed[c];
+                        }
+                }
+
+                set_levels(levels);
+
+                rgbstrp.commit();
+#ifdef BAM_STRIPS
+                bamstrps.commit();
+#endif
+
+                save_state();
+        }
+
+        banner_tx();
+
+#ifdef IDLE_SLEEP
+        idle();
+#endif
 }
\ No newline at end of file
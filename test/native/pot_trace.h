@@ -0,0 +1,89 @@
+  /*
+   * Copyright (C) 2020  Patrick Pedersen, The TU-DO Makespace
+
+   * This program is free software: you can redistribute it and/or modify
+   * it under the terms of the GNU General Public License as published by
+   * the Free Software Foundation, either version 3 of the License, or
+   * (at your option) any later version.
+
+   * This program is distributed in the hope that it will be useful,
+   * but WITHOUT ANY WARRANTY; without even the implied warranty of
+   * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   * GNU General Public License for more details.
+
+   * You should have received a copy of the GNU General Public License
+   * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+   *
+   * Author: Patrick Pedersen <ctx.xda@gmail.com>
+   * Description: Synthetic noisy potentiometer readings for the host tests
+   *
+   */
+
+
+#pragma once
+
+#include <stdint.h>
+
+#define TRACE_ADC_MAX 1023
+
+/*
+ * pot_trace
+ * ---------
+ * Description:
+ *      Emulates the ADC readings of a potentiometer at a given position. Every
+ *      conversion is disturbed by uniform noise and, if enabled, by a full scale
+ *      spike every spike_interval conversions. The pseudo random sequence is
+ *      seeded, so every test run sees the same trace.
+ *
+ *      These traces are synthetic stand-ins, not readings captured from a device.
+ *      Real potentiometer noise isn't uniform and may be correlated between
+ *      samples, so the tests only cover noise of the modelled amplitude.
+ */
+
+struct pot_trace {
+        uint32_t state;                 // Xorshift state
+        uint8_t noise;                  // Noise amplitude in ADC counts (+/-)
+        uint16_t spike_interval;        // Conversions between spikes (0 = off)
+        uint16_t conversions;           // Conversions since the last spike
+
+        pot_trace(uint8_t noise, uint16_t spike_interval = 0, uint32_t seed = 0x2545F491) :
+        state(seed), noise(noise), spike_interval(spike_interval), conversions(0)
+        {
+
+        }
+
+        uint32_t next()
+        {
+                state ^= state << 13;
+                state ^= state >> 17;
+                state ^= state << 5;
+                return state;
+        }
+
+        // Single conversion of the potentiometer at pos (in ADC counts)
+        uint16_t convert(int16_t pos)
+        {
+                int16_t x = pos;
+
+                if (noise)
+                        x += (int16_t) (next() % (2 * noise + 1)) - noise;
+
+                if (spike_interval && ++conversions >= spike_interval) {
+                        conversions = 0;
+                        x = TRACE_ADC_MAX;
+                }
+
+                return (x < 0) ? 0 : (x > TRACE_ADC_MAX) ? TRACE_ADC_MAX : x;
+        }
+
+        // Sample as fed to a PotFilter by pot_read() (See main.cpp)
+        uint16_t read(int16_t pos, uint8_t oversampling)
+        {
+                uint16_t sum = 0;
+
+                for (uint8_t i = 0; i < (1 << (2 * oversampling)); i++)
+                        sum += convert(pos);
+
+                return (sum >> oversampling) << (6 - oversampling);
+        }
+};
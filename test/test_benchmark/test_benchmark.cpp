@@ -0,0 +1,132 @@
+  /*
+   * Copyright (C) 2020  Patrick Pedersen, The TU-DO Makespace
+
+   * This program is free software: you can redistribute it and/or modify
+   * it under the terms of the GNU General Public License as published by
+   * the Free Software Foundation, either version 3 of the License, or
+   * (at your option) any later version.
+
+   * This program is distributed in the hope that it will be useful,
+   * but WITHOUT ANY WARRANTY; without even the implied warranty of
+   * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   * GNU General Public License for more details.
+
+   * You should have received a copy of the GNU General Public License
+   * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+   *
+   * Author: Patrick Pedersen <ctx.xda@gmail.com>
+   * Description: Host benchmark of the potentiometer sampling path
+   *
+   */
+
+
+#include <unity.h>
+#include <chrono>
+#include <stdio.h>
+
+#include "PotFilter.h"
+#include "MovementDetector.h"
+#include "pot_trace.h"
+
+#define BENCH_SAMPLES 100000
+#define BENCH_TRACE   1024 // Samples are read ahead of time, so the trace isn't timed
+
+static const pot_filter_config rgb_config = { 3, 2, 2, 0 };
+static const pot_filter_config m_config = { 3, 2, 2, 2 };
+
+static uint16_t samples[BENCH_TRACE];
+static uint16_t m_samples[BENCH_TRACE];
+static volatile uint16_t sink;
+
+void setUp()
+{
+        pot_trace trace(3);
+
+        // A slow turn back and forth
+        for (uint16_t i = 0; i < BENCH_TRACE; i++) {
+                int16_t pos = (i < BENCH_TRACE / 2) ? i : BENCH_TRACE - 1 - i;
+
+                samples[i] = trace.read(pos, 0);
+                m_samples[i] = trace.read(pos, 2);
+        }
+}
+
+void tearDown()
+{
+
+}
+
+template <typename F>
+static void report(const char *name, F step)
+{
+        char msg[64];
+        auto start = std::chrono::steady_clock::now();
+
+        for (uint32_t i = 0; i < BENCH_SAMPLES; i++)
+                step(i % BENCH_TRACE);
+
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+        snprintf(msg, sizeof(msg), "%s: %.1f ns per sample", name, (double) ns / BENCH_SAMPLES);
+        TEST_MESSAGE(msg);
+}
+
+void test_pot_filter_update()
+{
+        PotFilter filter(rgb_config);
+
+        report("PotFilter::update", [&](uint16_t i) {
+                sink = filter.update(samples[i]);
+        });
+}
+
+void test_oversampled_pot_filter_update()
+{
+        PotFilter filter(m_config);
+
+        report("PotFilter::update (oversampled)", [&](uint16_t i) {
+                sink = filter.update(m_samples[i]);
+        });
+}
+
+void test_movement_detector_update()
+{
+        MovementDetector detector(12, 9, 4, 3, 24);
+
+        report("MovementDetector::update", [&](uint16_t i) {
+                uint16_t level = samples[i];
+                uint16_t levels[MOVEMENT_CHANNELS] = { level, level, level, level };
+
+                sink = detector.update(levels);
+        });
+}
+
+// Everything done per potentiometer sample, by rgbm_pots_read() and rgbm_pot_mov_det()
+void test_sample_path()
+{
+        PotFilter filters[MOVEMENT_CHANNELS] = {
+                PotFilter(rgb_config), PotFilter(rgb_config), PotFilter(rgb_config), PotFilter(m_config)
+        };
+        MovementDetector detector(12, 9, 4, 3, 24);
+
+        report("Sample path (4 filters and detector)", [&](uint16_t i) {
+                uint16_t levels[MOVEMENT_CHANNELS];
+
+                for (uint8_t j = 0; j < MOVEMENT_CHANNELS; j++) {
+                        filters[j].update(j == 3 ? m_samples[i] : samples[i]);
+                        levels[j] = filters[j].level();
+                }
+
+                sink = detector.update(levels);
+        });
+}
+
+int main()
+{
+        UNITY_BEGIN();
+        RUN_TEST(test_pot_filter_update);
+        RUN_TEST(test_oversampled_pot_filter_update);
+        RUN_TEST(test_movement_detector_update);
+        RUN_TEST(test_sample_path);
+        return UNITY_END();
+}
@@ -0,0 +1,137 @@
+  /*
+   * Copyright (C) 2020  Patrick Pedersen, The TU-DO Makespace
+
+   * This program is free software: you can redistribute it and/or modify
+   * it under the terms of the GNU General Public License as published by
+   * the Free Software Foundation, either version 3 of the License, or
+   * (at your option) any later version.
+
+   * This program is distributed in the hope that it will be useful,
+   * but WITHOUT ANY WARRANTY; without even the implied warranty of
+   * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   * GNU General Public License for more details.
+
+   * You should have received a copy of the GNU General Public License
+   * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+   *
+   * Author: Patrick Pedersen <ctx.xda@gmail.com>
+   * Description: Host tests of the potentiometer movement detection
+   *
+   */
+
+
+#include <unity.h>
+
+#include "PotFilter.h"
+#include "MovementDetector.h"
+#include "pot_trace.h"
+
+// Defaults of config.h
+#define BASELINE_SHIFT 12
+#define NOISE_SHIFT    9
+#define SIGMAS         4
+#define MAX_DEV        3
+#define CEILING        24
+
+static const pot_filter_config filter_config = { 3, 2, 2, 0 };
+
+/*
+ * pot_bench
+ * ---------
+ * Description:
+ *      Four potentiometers at the same position, fed through their
+ *      filter chains into a movement detector, as done by main.cpp
+ */
+
+struct pot_bench {
+        PotFilter filters[MOVEMENT_CHANNELS];
+        MovementDetector detector;
+        pot_trace trace;
+
+        pot_bench(uint8_t noise) :
+        detector(BASELINE_SHIFT, NOISE_SHIFT, SIGMAS, MAX_DEV, CEILING), trace(noise)
+        {
+                for (uint8_t i = 0; i < MOVEMENT_CHANNELS; i++)
+                        filters[i] = PotFilter(filter_config);
+        }
+
+        // Feeds n samples, returns the number of samples with movement
+        uint16_t feed(int16_t pos, uint16_t n)
+        {
+                uint16_t moves = 0;
+
+                for (uint16_t i = 0; i < n; i++) {
+                        uint16_t levels[MOVEMENT_CHANNELS];
+
+                        for (uint8_t j = 0; j < MOVEMENT_CHANNELS; j++) {
+                                filters[j].update(trace.read(pos, 0));
+                                levels[j] = filters[j].level();
+                        }
+
+                        if (detector.update(levels))
+                                moves++;
+                }
+
+                return moves;
+        }
+};
+
+void setUp()
+{
+
+}
+
+void tearDown()
+{
+
+}
+
+// Noise is tolerated right from the start, as the worst noise is assumed until it has been learned
+void test_noise_is_not_movement()
+{
+        for (uint8_t noise = 0; noise <= 8; noise += 2) {
+                pot_bench bench(noise);
+
+                TEST_ASSERT_EQUAL_UINT16_MESSAGE(0, bench.feed(512, 10000), "Noise reported as movement");
+        }
+}
+
+void test_drift_is_not_movement()
+{
+        pot_bench bench(2);
+
+        bench.feed(500, 2000);
+
+        // 20 ADC counts within 16 s at 2 ms per sample
+        for (int16_t pos = 500; pos < 520; pos++)
+                TEST_ASSERT_EQUAL_UINT16_MESSAGE(0, bench.feed(pos, 400), "Drift reported as movement");
+}
+
+void test_turn_is_movement()
+{
+        pot_bench bench(2);
+
+        bench.feed(500, 2000);
+
+        // 4 8-bit steps, just past the min. threshold of 3 steps
+        TEST_ASSERT_TRUE_MESSAGE(bench.feed(500 + 4 * 4, 20) > 0, "Turn not reported");
+}
+
+// The threshold of a noisy pot is capped at the ceiling, so it remains responsive
+void test_noisy_pot_remains_responsive()
+{
+        pot_bench bench(40);
+
+        bench.feed(500, 4000);
+        TEST_ASSERT_TRUE_MESSAGE(bench.feed(500 + (CEILING + 4) * 4, 20) > 0, "Turn of a noisy pot not reported");
+}
+
+int main()
+{
+        UNITY_BEGIN();
+        RUN_TEST(test_noise_is_not_movement);
+        RUN_TEST(test_drift_is_not_movement);
+        RUN_TEST(test_turn_is_movement);
+        RUN_TEST(test_noisy_pot_remains_responsive);
+        return UNITY_END();
+}
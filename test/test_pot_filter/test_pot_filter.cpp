@@ -0,0 +1,198 @@
+  /*
+   * Copyright (C) 2020  Patrick Pedersen, The TU-DO Makespace
+
+   * This program is free software: you can redistribute it and/or modify
+   * it under the terms of the GNU General Public License as published by
+   * the Free Software Foundation, either version 3 of the License, or
+   * (at your option) any later version.
+
+   * This program is distributed in the hope that it will be useful,
+   * but WITHOUT ANY WARRANTY; without even the implied warranty of
+   * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   * GNU General Public License for more details.
+
+   * You should have received a copy of the GNU General Public License
+   * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+   *
+   * Author: Patrick Pedersen <ctx.xda@gmail.com>
+   * Description: Host tests of the potentiometer filter chain
+   *
+   */
+
+
+#include <unity.h>
+
+#include "PotFilter.h"
+#include "pot_trace.h"
+
+// Default filter chains of the R, G, B and M potentiometers (See config.h)
+static const pot_filter_config rgb_config = { 3, 2, 2, 0 };
+static const pot_filter_config m_config = { 3, 2, 2, 2 };
+
+void setUp()
+{
+
+}
+
+void tearDown()
+{
+
+}
+
+// Feeds n samples of a potentiometer at pos, returns the number of output changes
+static uint16_t feed(PotFilter &filter, pot_trace &trace, int16_t pos, uint16_t n)
+{
+        uint16_t changes = 0;
+        uint16_t last = filter.fine();
+
+        for (uint16_t i = 0; i < n; i++) {
+                filter.update(trace.read(pos, filter.oversampling()));
+
+                if (filter.fine() != last)
+                        changes++;
+
+                last = filter.fine();
+        }
+
+        return changes;
+}
+
+static void check_rest_is_stable(pot_filter_config config, uint8_t noise, uint16_t spike_interval)
+{
+        // Positions every 7 counts, including many right at the border of two output steps
+        for (int16_t pos = 0; pos <= TRACE_ADC_MAX; pos += 7) {
+                PotFilter filter(config);
+                pot_trace trace(noise, spike_interval, 0x2545F491 + pos);
+
+                int16_t step;
+
+                // The filter is primed with a single noisy sample and may settle on the neighbouring step
+                feed(filter, trace, pos, 256);
+                step = (int16_t) filter.value() - (int16_t) (((uint32_t) pos * 255 + TRACE_ADC_MAX / 2) / TRACE_ADC_MAX);
+                TEST_ASSERT_TRUE_MESSAGE(step >= -1 && step <= 1, "Output settles off its position");
+                TEST_ASSERT_EQUAL_UINT16_MESSAGE(0, feed(filter, trace, pos, 4000), "Output toggles at rest");
+        }
+}
+
+void test_rest_is_stable()
+{
+        check_rest_is_stable(rgb_config, 2, 0);
+}
+
+void test_oversampled_rest_is_stable()
+{
+        check_rest_is_stable(m_config, 2, 0);
+}
+
+void test_spikes_are_removed()
+{
+        check_rest_is_stable(rgb_config, 2, 13);
+}
+
+static void check_ends_are_reached(pot_filter_config config)
+{
+        PotFilter filter(config);
+        pot_trace trace(2);
+
+        feed(filter, trace, TRACE_ADC_MAX / 2, 64);
+        feed(filter, trace, 0, 64);
+        TEST_ASSERT_EQUAL_UINT8(0, filter.value());
+        TEST_ASSERT_EQUAL_UINT16(0, filter.fine());
+
+        feed(filter, trace, TRACE_ADC_MAX, 64);
+        TEST_ASSERT_EQUAL_UINT8(255, filter.value());
+        TEST_ASSERT_EQUAL_UINT16(0xFF00, filter.fine());
+}
+
+void test_ends_are_reached()
+{
+        check_ends_are_reached(rgb_config);
+}
+
+void test_oversampled_ends_are_reached()
+{
+        check_ends_are_reached(m_config);
+}
+
+// A potentiometer spanning 40 - 980 ADC counts, calibrated as by apply_calibration() in main.cpp
+void test_calibrated_ends_are_reached()
+{
+        const uint16_t guard = 3;
+        PotFilter filter(m_config);
+        pot_trace trace(2);
+
+        filter.set_range((40 + guard) << 6, (980 - guard) << 6);
+
+        feed(filter, trace, 40, 64);
+        TEST_ASSERT_EQUAL_UINT16(0, filter.fine());
+
+        feed(filter, trace, 980, 64);
+        TEST_ASSERT_EQUAL_UINT16(0xFF00, filter.fine());
+}
+
+static void check_ramp(pot_filter_config config, uint16_t min_steps)
+{
+        PotFilter filter(config);
+        pot_trace trace(1);
+        uint16_t last = 0;
+        uint16_t steps = 0;
+
+        feed(filter, trace, 0, 64);
+
+        // Slow turn across the whole range, 4 samples per ADC count
+        for (int16_t pos = 0; pos <= TRACE_ADC_MAX; pos++) {
+                for (uint8_t i = 0; i < 4; i++) {
+                        filter.update(trace.read(pos, filter.oversampling()));
+                        TEST_ASSERT_TRUE_MESSAGE(filter.fine() >= last, "Output steps back during a turn");
+
+                        if (filter.fine() != last)
+                                steps++;
+
+                        last = filter.fine();
+                }
+        }
+
+        feed(filter, trace, TRACE_ADC_MAX, 64);
+        TEST_ASSERT_EQUAL_UINT16(0xFF00, filter.fine());
+        TEST_ASSERT_TRUE_MESSAGE(steps >= min_steps, "Output resolution lost");
+}
+
+void test_ramp_is_monotonic()
+{
+        check_ramp(rgb_config, 250);
+}
+
+void test_oversampled_ramp_is_fine()
+{
+        check_ramp(m_config, 1000);
+}
+
+void test_lower_bound_gate()
+{
+        PotFilter filter(rgb_config);
+        pot_trace trace(1);
+
+        filter.set_lower_bound(5);
+
+        feed(filter, trace, 5 * 4, 64);
+        TEST_ASSERT_EQUAL_UINT8(0, filter.value());
+        TEST_ASSERT_EQUAL_UINT16(0, filter.fine());
+
+        feed(filter, trace, 10 * 4, 64);
+        TEST_ASSERT_TRUE(filter.value() > 5);
+}
+
+int main()
+{
+        UNITY_BEGIN();
+        RUN_TEST(test_rest_is_stable);
+        RUN_TEST(test_oversampled_rest_is_stable);
+        RUN_TEST(test_spikes_are_removed);
+        RUN_TEST(test_ends_are_reached);
+        RUN_TEST(test_oversampled_ends_are_reached);
+        RUN_TEST(test_calibrated_ends_are_reached);
+        RUN_TEST(test_ramp_is_monotonic);
+        RUN_TEST(test_oversampled_ramp_is_fine);
+        RUN_TEST(test_lower_bound_gate);
+        return UNITY_END();
+}
@@ -0,0 +1,273 @@
+#!/usr/bin/env python3
+
+# Copyright (C) 2020  Patrick Pedersen, The TU-DO Makespace
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <https://www.gnu.org/licenses/>.
+#
+# Author: Patrick Pedersen <ctx.xda@gmail.com>
+# Description: Builds an EEPROM image of the patch banks from a JSON description
+
+"""
+Builds an EEPROM image holding the patch banks described by a JSON file,
+which can be flashed alongside the firmware (ex. using avrdude -U eeprom:w:patches.hex:i).
+
+The image contains a freshly formatted patch journal (layout 4, see
+src/Journal.h) with one record per described patch, encoded exactly like
+encode_patch() in src/main.cpp does. Patches that aren't described keep
+their factory defaults. The journal address, size of the gesture region,
+number of banks, fade time unit and factory defaults are read from src/config.h.
+The gesture region at the end of the EEPROM and the potentiometer calibration
+are left erased.
+
+Description format:
+
+    {
+        "banks": [
+            [
+                { "color": "#000000", "main": 255 },
+                { "color": "#FF7814", "main": 128, "fade": 2.5 },
+                null,
+                ...
+            ],
+            ...
+        ]
+    }
+
+Every bank holds up to 10 patches, null skips a patch. "color" is the RGB
+color as html code, "main" the brightness of the main light (0 - 255) and
+"fade" the fade time in seconds. Omitted values take their defaults.
+"""
+
+import argparse
+import json
+import os
+import re
+import sys
+
+EEPROM_SIZE = 1024 # ATmega328
+
+JOURNAL_MAGIC = 0x4454
+JOURNAL_VERSION = 4
+JOURNAL_BLOCK_SIZE = 4
+JOURNAL_HEADER_SIZE = 4 # magic, version, crc
+JOURNAL_RECORD_SIZE = 7 # seq[3], key, len, crc16
+JOURNAL_MAX_KEYS = 64
+
+NO_FADE_TIME = 0xFF
+
+FIELD_COLOR = 0
+FIELD_COLOR_DIFF = 1
+FIELD_FADE = 2
+
+CONFIG_H = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "src", "config.h")
+
+
+def crc8(data):
+        """CRC-8 (CCITT polynomial), as computed by _crc8_ccitt_update() with an initial value of 0xFF"""
+        crc = 0xFF
+
+        for byte in data:
+                crc ^= byte
+
+                for _ in range(8):
+                        crc = ((crc << 1) ^ 0x07) & 0xFF if crc & 0x80 else (crc << 1) & 0xFF
+
+        return crc
+
+
+def crc16(data):
+        """CRC-16 (IBM polynomial), as computed by _crc16_update() with an initial value of 0xFFFF"""
+        crc = 0xFFFF
+
+        for byte in data:
+                crc ^= byte
+
+                for _ in range(8):
+                        crc = (crc >> 1) ^ 0xA001 if crc & 1 else crc >> 1
+
+        return crc
+
+
+def read_config(path):
+        """Reads the defines relevant to the EEPROM layout from config.h"""
+        with open(path) as f:
+                src = f.read()
+
+        def define(name):
+                match = re.search(r"^#define\s+" + name + r"\s+(\w+)", src, re.MULTILINE)
+
+                if not match:
+                        sys.exit("%s: %s not found" % (path, name))
+
+                return int(match.group(1), 0)
+
+        match = re.search(r"^#define\s+FACTORY_PATCHES\s*\{(.*?)^\}", src, re.MULTILINE | re.DOTALL)
+
+        if not match:
+                sys.exit("%s: FACTORY_PATCHES not found" % path)
+
+        body = re.sub(r"/\*.*?\*/", "", match.group(1), flags=re.DOTALL)
+        factory = [[int(v, 0) for v in p.split(",")] for p in re.findall(r"\{([^{}]*)\}", body)]
+
+        if len(factory) != 10 or any(len(p) != 4 for p in factory):
+                sys.exit("%s: FACTORY_PATCHES must hold 10 patches of {R, G, B, M}" % path)
+
+        return {
+                "journal_addr": define("EEPROM_JOURNAL_ADDR"),
+                "gesture_size": define("EEPROM_GESTURE_SIZE"),
+                "num_banks": define("NUM_BANKS"),
+                "fade_time_unit": define("FADE_TIME_UNIT"),
+                "factory": factory,
+        }
+
+
+def parse_patch(desc, factory, fade_time_unit, where):
+        """Converts a patch description into {R, G, B, M} and a fade time (in fade time units)"""
+        unknown = set(desc) - {"color", "main", "fade"}
+
+        if unknown:
+                sys.exit("%s: Unknown field(s) %s" % (where, ", ".join(sorted(unknown))))
+
+        color = list(factory)
+
+        if "color" in desc:
+                match = re.fullmatch(r"#([0-9a-fA-F]{6})", desc["color"])
+
+                if not match:
+                        sys.exit("%s: Color must be a html code (ex. #FF7814)" % where)
+
+                color[0:3] = bytes.fromhex(match.group(1))
+
+        if "main" in desc:
+                if not isinstance(desc["main"], int) or not 0 <= desc["main"] <= 255:
+                        sys.exit("%s: Main light must be between 0 and 255" % where)
+
+                color[3] = desc["main"]
+
+        fade = NO_FADE_TIME
+
+        if "fade" in desc:
+                fade = round(desc["fade"] * 1000 / fade_time_unit)
+
+                if not 0 <= fade < NO_FADE_TIME:
+                        sys.exit("%s: Fade time must be between 0 and %g s" % (where, (NO_FADE_TIME - 1) * fade_time_unit / 1000))
+
+        return color, fade
+
+
+def encode_patch(color, fade, factory):
+        """Encodes a patch into type tagged fields, mirroring encode_patch() in src/main.cpp"""
+        mask = 0
+        diffs = []
+        rec = bytearray()
+
+        for i in range(4):
+                if color[i] != factory[i]:
+                        mask |= 1 << i
+                        diffs.append(color[i])
+
+        if 0 < len(diffs) < 3:
+                rec.append(FIELD_COLOR_DIFF << 4 | (1 + len(diffs)))
+                rec.append(mask)
+                rec += bytes(diffs)
+        elif diffs:
+                rec.append(FIELD_COLOR << 4 | 4)
+                rec += bytes(color)
+
+        if fade != NO_FADE_TIME:
+                rec.append(FIELD_FADE << 4 | 1)
+                rec.append(fade)
+
+        return bytes(rec)
+
+
+def build_image(desc, config):
+        """Builds the EEPROM image of a patch bank description"""
+        image = bytearray([0xFF] * EEPROM_SIZE)
+        addr = config["journal_addr"]
+        end = EEPROM_SIZE - config["gesture_size"] # EEPROM_GESTURE_ADDR
+        blocks = (end - addr - JOURNAL_HEADER_SIZE) // JOURNAL_BLOCK_SIZE
+        banks = desc.get("banks", [])
+        block = 0
+        seq = 0
+
+        if len(banks) > config["num_banks"]:
+                sys.exit("The firmware is configured for %d banks (NUM_BANKS), but %d are described" % (config["num_banks"], len(banks)))
+
+        header = bytes([JOURNAL_MAGIC & 0xFF, JOURNAL_MAGIC >> 8, JOURNAL_VERSION])
+        image[addr:addr + JOURNAL_HEADER_SIZE] = header + bytes([crc8(header)])
+
+        for b, bank in enumerate(banks):
+                if len(bank) > 10:
+                        sys.exit("Bank %d: A bank holds at most 10 patches" % b)
+
+                for p, patch in enumerate(bank):
+                        if patch is None:
+                                continue
+
+                        factory = config["factory"][p]
+                        color, fade = parse_patch(patch, factory, config["fade_time_unit"], "Bank %d, patch %d" % (b, p))
+                        data = encode_patch(color, fade, factory)
+                        size = -(-(JOURNAL_RECORD_SIZE + len(data)) // JOURNAL_BLOCK_SIZE)
+
+                        if block + size > blocks:
+                                sys.exit("The patches don't fit into the EEPROM")
+
+                        rec = bytes([seq & 0xFF, (seq >> 8) & 0xFF, seq >> 16, b * 10 + p, len(data)])
+                        crc = crc16(rec + data)
+                        start = addr + JOURNAL_HEADER_SIZE + block * JOURNAL_BLOCK_SIZE
+
+                        image[start:start + JOURNAL_RECORD_SIZE + len(data)] = rec + bytes([crc & 0xFF, crc >> 8]) + data
+
+                        block += size
+                        seq += 1
+
+        return image
+
+
+def intel_hex(image):
+        """Formats an image as Intel HEX, as accepted by avrdude"""
+        lines = []
+
+        for addr in range(0, len(image), 16):
+                chunk = image[addr:addr + 16]
+                rec = bytes([len(chunk), addr >> 8, addr & 0xFF, 0x00]) + chunk
+                lines.append(":" + rec.hex().upper() + "%02X" % (-sum(rec) & 0xFF))
+
+        lines.append(":00000001FF")
+        return "\n".join(lines) + "\n"
+
+
+def main():
+        parser = argparse.ArgumentParser(description="Builds an EEPROM image of the patch banks from a JSON description")
+        parser.add_argument("description", help="JSON patch bank description")
+        parser.add_argument("output", help="Output image (.hex for Intel HEX, raw binary otherwise)")
+        parser.add_argument("--config", default=CONFIG_H, help="Firmware config.h (default: %(default)s)")
+        args = parser.parse_args()
+
+        with open(args.description) as f:
+                desc = json.load(f)
+
+        image = build_image(desc, read_config(args.config))
+
+        if args.output.lower().endswith(".hex"):
+                with open(args.output, "w") as f:
+                        f.write(intel_hex(image))
+        else:
+                with open(args.output, "wb") as f:
+                        f.write(image)
+
+
+if __name__ == "__main__":
+        main()